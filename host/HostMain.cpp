@@ -0,0 +1,162 @@
+/**
+ * @file    HostMain.cpp
+ *
+ * @brief   Runs the sketch on the host, against the mock Arduino core. The
+ *          sketch is run for a length of virtual time, calling loop() at a
+ *          fixed step, and a script may send serial commands and press buttons
+ *          at given times. Serial output is written to stdout, followed by a
+ *          summary of the run.
+ *
+ *          Usage: nuka_cola_host [-d duration_ms] [-s step_us] [script]
+ *
+ *          Each line of the script is a time in milliseconds followed by an
+ *          action, and blank lines and lines starting with '#' are ignored:
+ *
+ *              <ms> serial <text>      Sends the text, followed by a new line
+ *              <ms> pin <pin> <level>  Sets an input pin high (1) or low (0)
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include <HostCore.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "sketch_nuka_cola.ino"
+
+/**
+ * An action taken by the script at a given time.
+ */
+struct ScriptAction
+{
+    /// @brief  The time of the action, in milliseconds.
+    unsigned long long timeMs;
+    /// @brief  The action, "serial" or "pin".
+    std::string action;
+    /// @brief  The rest of the line.
+    std::string argument;
+};
+
+/*******************************************************************************
+ * @brief   Reads a script of actions from a file.
+ *
+ * @param   path    The path of the script
+ * @param   actions The list to add the actions to
+ *
+ * @return  True if the script was read, false otherwise.
+ */
+static bool readScript(const char *path, std::vector<ScriptAction> &actions)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Unable to open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        ScriptAction action;
+        if (!(fields >> action.timeMs >> action.action))
+        {
+            std::cerr << "Bad script line: " << line << std::endl;
+            return false;
+        }
+        std::getline(fields >> std::ws, action.argument);
+        actions.push_back(action);
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * @brief   Carries out an action from the script.
+ *
+ * @param   action  The action
+ */
+static void runAction(const ScriptAction &action)
+{
+    if (action.action == "serial")
+    {
+        hostSerialSend(action.argument + "\n");
+    }
+    else if (action.action == "pin")
+    {
+        std::istringstream fields(action.argument);
+        int pin = 0;
+        int level = 0;
+        fields >> pin >> level;
+        hostSetInput(pin, level ? HIGH : LOW);
+    }
+    else
+    {
+        std::cerr << "Unknown action: " << action.action << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long durationMs = 10000;
+    unsigned long stepUs = 100;
+    std::vector<ScriptAction> actions;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-d" && i + 1 < argc)
+        {
+            durationMs = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "-s" && i + 1 < argc)
+        {
+            stepUs = max(1UL, strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!readScript(argv[i], actions))
+        {
+            return 1;
+        }
+    }
+
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    setup();
+    size_t next = 0;
+    while (hostTimeUs() < durationMs * 1000ULL)
+    {
+        while (next < actions.size() &&
+               actions[next].timeMs * 1000ULL <= hostTimeUs())
+        {
+            runAction(actions[next]);
+            ++next;
+        }
+        loop();
+        std::cout << hostSerialTake();
+        hostAdvanceUs(stepUs);
+    }
+
+    const double wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "\n--- host run ---\n"
+              << "virtual time: " << durationMs << " ms\n"
+              << "wall time:    " << (unsigned long)wallMs << " ms\n"
+              << "speed up:     " << (unsigned long)(durationMs / max(wallMs, 1.0)) << "x\n"
+              << "PWM writes:   ";
+    for (uint8_t pin = 0; pin < HOST_PIN_COUNT; ++pin)
+    {
+        if (hostPwmWrites(pin) != 0)
+        {
+            std::cout << "D" << (int)pin << "=" << hostPwmWrites(pin) << " ";
+        }
+    }
+    std::cout << "\n"
+              << "EEPROM:       " << EEPROM.writeCount << " writes, "
+              << EEPROM.maxCellWrites() << " to the most worn cell\n";
+    return 0;
+}
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Records the pattern benchmark and the memory footprint of the sketch, as
+# comma separated values that can be kept and diffed between commits.
+#
+# Usage: bench.sh [-p serial_port] [-o output_dir]
+#
+#   size.csv    The flash and SRAM used, from avr-size, when arduino-cli and
+#               avr-size are installed.
+#   bench.csv   The reply to "bench?" from a Nano on the given serial port.
+#               The cycle counts come from the AVR's own timer, so they can
+#               only be measured on the hardware; on the host, time is virtual.
+
+set -e
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+SKETCH_DIR="$SCRIPT_DIR/../sketch_nuka_cola"
+FQBN=arduino:avr:nano
+PORT=
+OUT_DIR="$SCRIPT_DIR/build/bench"
+
+while getopts "p:o:" opt; do
+    case $opt in
+        p) PORT=$OPTARG ;;
+        o) OUT_DIR=$OPTARG ;;
+        *) sed -n 5p "$0" | cut -c3- >&2; exit 1 ;;
+    esac
+done
+
+mkdir -p "$OUT_DIR"
+
+if command -v arduino-cli >/dev/null 2>&1 && command -v avr-size >/dev/null 2>&1; then
+    arduino-cli compile -b "$FQBN" --output-dir "$OUT_DIR/elf" "$SKETCH_DIR" >/dev/null
+    # Berkeley format: text data bss dec hex filename
+    avr-size "$OUT_DIR"/elf/*.elf | awk 'NR == 2 {
+        print "text,data,bss,flash_bytes,sram_bytes"
+        print $1 "," $2 "," $3 "," $1 + $2 "," $2 + $3
+    }' > "$OUT_DIR/size.csv"
+    echo "wrote $OUT_DIR/size.csv"
+else
+    echo "arduino-cli and avr-size not found, skipping size.csv" >&2
+fi
+
+if [ -n "$PORT" ]; then
+    stty -F "$PORT" 9600 raw -echo
+    exec 3<>"$PORT"
+    # Opening the port resets the Nano, so give the bootloader time to finish
+    sleep 2
+    printf 'bench?\n' >&3
+    # The table ends when the device stops sending
+    : > "$OUT_DIR/bench.csv"
+    while IFS= read -r -t 5 line <&3; do
+        printf '%s\n' "$line" | tr -d '\r' >> "$OUT_DIR/bench.csv"
+    done
+    exec 3<&-
+    echo "wrote $OUT_DIR/bench.csv"
+else
+    echo "no serial port given (-p), skipping bench.csv" >&2
+fi
@@ -0,0 +1,226 @@
+/**
+ * @file    Arduino.h
+ *
+ * @brief   Provides a mock of the Arduino core, so that the sketch sources can
+ *          be built unchanged and run on the host. Time is virtual, and only
+ *          moves when the host code advances it (see HostCore.h), so days of
+ *          operation can be simulated in seconds. The mock models an Arduino
+ *          Nano: the pin to port mapping, the pin change interrupts and the
+ *          timer 2 overflow interrupt used as the frame tick are all provided,
+ *          with the interrupt service routines run as the virtual time passes.
+ *          PWM writes are captured per pin rather than written to the timers.
+ *
+ *          Note that on the host, int is 32 bits and long is 64 bits, rather
+ *          than 16 and 32 bits as on the AVR, so 16-bit overflows and the
+ *          49.7 day rollover of millis() are not reproduced.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <avr/pgmspace.h>
+
+/**
+ * Constants
+ */
+
+#define HIGH            0x1
+#define LOW             0x0
+
+#define INPUT           0x0
+#define OUTPUT          0x1
+#define INPUT_PULLUP    0x2
+
+#define DEC             10
+#define HEX             16
+#define OCT             8
+#define BIN             2
+
+/// @brief  The clock speed of the Nano.
+#define F_CPU           16000000L
+
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+#define bit(b)          (1UL << (b))
+#define _BV(b)          (1 << (b))
+
+#define constrain(amt, low, high) \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+/// @brief  The last EEPROM address of the ATmega328P.
+#define E2END           0x3FF
+
+/// @brief  The Arduino port numbers of the Nano's ports.
+#define PB              2
+#define PC              3
+#define PD              4
+
+/**
+ * Type definitions
+ */
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/// @brief  Marks a string as held in flash. There is no flash on the host, so
+///         these are ordinary strings.
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+/*******************************************************************************
+ * @brief   Gets the smaller of two values. The Arduino core provides this as
+ *          a macro, which accepts mixed types, so this does the same.
+ *
+ * @param   a   The first value
+ * @param   b   The second value
+ *
+ * @return  The smaller value, as the common type of the two.
+ */
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(const A &a, const B &b)
+{
+    return (a < b) ? a : b;
+}
+
+/*******************************************************************************
+ * @brief   Gets the larger of two values. The Arduino core provides this as
+ *          a macro, which accepts mixed types, so this does the same.
+ *
+ * @param   a   The first value
+ * @param   b   The second value
+ *
+ * @return  The larger value, as the common type of the two.
+ */
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(const A &a, const B &b)
+{
+    return (a > b) ? a : b;
+}
+
+/**
+ * Time, on the virtual clock.
+ */
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/**
+ * Digital and analogue pins.
+ */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+int analogRead(uint8_t pin);
+
+/**
+ * Interrupts. While disabled, any interrupts raised are held pending, and run
+ * as soon as they are enabled again, as on the AVR.
+ */
+void noInterrupts();
+void interrupts();
+
+/// @brief  Defines an interrupt service routine, which the virtual hardware
+///         calls by name.
+#define ISR(vector, ...) extern "C" void vector(void)
+
+/**
+ * Characters.
+ */
+inline bool isDigit(const int c)
+{
+    return isdigit(c) != 0;
+}
+
+/**
+ * Port registers. The input registers hold the level of every pin, whether
+ * driven by the sketch or by the host.
+ */
+extern volatile uint8_t hostPortInputs[PD + 1];
+extern volatile uint8_t hostPcmsk[3];
+extern volatile uint8_t hostPcicr;
+extern volatile uint8_t hostTimsk2;
+
+#define digitalPinToPort(p) \
+    (((p) <= 7) ? PD : (((p) <= 13) ? PB : PC))
+#define digitalPinToBitMask(p) \
+    ((uint8_t)_BV(((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14))))
+#define portInputRegister(port) (&hostPortInputs[(port)])
+
+#define PCICR       hostPcicr
+#define PCMSK0      hostPcmsk[0]
+#define PCMSK1      hostPcmsk[1]
+#define PCMSK2      hostPcmsk[2]
+#define digitalPinToPCICR(p) \
+    (((p) >= 0 && (p) <= 21) ? (&PCICR) : ((volatile uint8_t *)0))
+#define digitalPinToPCICRbit(p) \
+    (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) \
+    (&hostPcmsk[digitalPinToPCICRbit(p)])
+#define digitalPinToPCMSKbit(p) \
+    (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+#define TIMSK2      hostTimsk2
+#define TOIE2       0
+
+/**
+ * Serial port stand-in. Bytes sent by the host are read by the sketch, and
+ * everything printed by the sketch is collected for the host to read.
+ */
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    void end();
+    int available();
+    int peek();
+    int read();
+    size_t readBytes(char *buffer, size_t length);
+    size_t write(uint8_t value);
+    size_t write(const char *text);
+
+    size_t print(const __FlashStringHelper *text);
+    size_t print(const char *text);
+    size_t print(char value);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+
+    size_t println();
+    size_t println(const __FlashStringHelper *text);
+    size_t println(const char *text);
+    size_t println(char value);
+    size_t println(unsigned char value, int base = DEC);
+    size_t println(int value, int base = DEC);
+    size_t println(unsigned int value, int base = DEC);
+    size_t println(long value, int base = DEC);
+    size_t println(unsigned long value, int base = DEC);
+
+    /***************************************************************************
+     * @brief   The port is always connected.
+     */
+    explicit operator bool() const
+    {
+        return true;
+    }
+
+    /// @brief  The bytes received and not yet read by the sketch.
+    std::string received;
+    /// @brief  The bytes printed by the sketch and not yet taken by the host.
+    std::string sent;
+
+private:
+    size_t printNumber(unsigned long value, int base);
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,121 @@
+/**
+ * @file    EEPROM.h
+ *
+ * @brief   Provides a mock of the Arduino EEPROM library, holding the 1KB of
+ *          EEPROM of the ATmega328P in memory. Every read and write is counted,
+ *          and the writes are also counted per cell, so that the wear caused by
+ *          the sketch can be measured.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+
+/**
+ * The in-memory EEPROM. As on the device, erased cells read as 0xFF.
+ */
+class EEPROMClass
+{
+public:
+    /// @brief  The size of the EEPROM, in bytes.
+    static const int SIZE = E2END + 1;
+
+    EEPROMClass()
+    {
+        clear();
+    }
+
+    /***************************************************************************
+     * @brief   Erases the EEPROM and clears the access counts.
+     */
+    void clear()
+    {
+        memset(cells, 0xFF, sizeof(cells));
+        memset(cellWrites, 0, sizeof(cellWrites));
+        readCount = 0;
+        writeCount = 0;
+    }
+
+    uint8_t read(const int address)
+    {
+        ++readCount;
+        return cells[address];
+    }
+
+    void write(const int address, const uint8_t value)
+    {
+        ++writeCount;
+        ++cellWrites[address];
+        cells[address] = value;
+    }
+
+    void update(const int address, const uint8_t value)
+    {
+        if (read(address) != value)
+        {
+            write(address, value);
+        }
+    }
+
+    template <typename T>
+    T &get(const int address, T &value)
+    {
+        uint8_t *bytes = reinterpret_cast<uint8_t *>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            bytes[i] = read(address + i);
+        }
+        return value;
+    }
+
+    template <typename T>
+    const T &put(const int address, const T &value)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            update(address + i, bytes[i]);
+        }
+        return value;
+    }
+
+    uint16_t length() const
+    {
+        return SIZE;
+    }
+
+    /***************************************************************************
+     * @brief   Gets the highest number of writes made to any one cell.
+     *
+     * @return  The number of writes to the most worn cell.
+     */
+    unsigned long maxCellWrites() const
+    {
+        unsigned long worst = 0;
+        for (int i = 0; i < SIZE; ++i)
+        {
+            worst = max(worst, cellWrites[i]);
+        }
+        return worst;
+    }
+
+    /// @brief  The contents of the EEPROM.
+    uint8_t cells[SIZE];
+    /// @brief  The number of writes made to each cell.
+    unsigned long cellWrites[SIZE];
+    /// @brief  The number of bytes read.
+    unsigned long readCount;
+    /// @brief  The number of bytes written.
+    unsigned long writeCount;
+};
+
+/*******************************************************************************
+ * @brief   Gets the EEPROM, created on first use so that it can be used from
+ *          the constructors of other static objects.
+ *
+ * @return  The EEPROM.
+ */
+EEPROMClass &hostEeprom();
+
+#define EEPROM hostEeprom()
@@ -0,0 +1,494 @@
+/**
+ * @file    HostCore.cpp
+ *
+ * @brief   Implements the mock Arduino core and the controls of the virtual
+ *          hardware. See Arduino.h and HostCore.h.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostCore.h"
+
+/**
+ * The interrupt service routines, defined by the sketch sources. These are
+ * weak references, as a test may not include the sources defining them.
+ */
+extern "C" void TIMER2_OVF_vect(void) __attribute__((weak));
+extern "C" void PCINT0_vect(void) __attribute__((weak));
+extern "C" void PCINT1_vect(void) __attribute__((weak));
+extern "C" void PCINT2_vect(void) __attribute__((weak));
+
+/// @brief  The number of analogue inputs of the Nano.
+static const uint8_t ANALOG_PIN_COUNT = 8;
+
+volatile uint8_t hostPortInputs[PD + 1];
+volatile uint8_t hostPcmsk[3];
+volatile uint8_t hostPcicr;
+volatile uint8_t hostTimsk2;
+
+HardwareSerial Serial;
+
+/// @brief  The virtual time since reset, in microseconds.
+static unsigned long long timeUs;
+/// @brief  The virtual time of the next timer 2 overflow, in microseconds.
+static unsigned long long nextOverflowUs = HOST_TIMER2_PERIOD_US;
+/// @brief  Whether interrupts are enabled.
+static bool interruptsEnabled = true;
+/// @brief  Whether a timer 2 overflow is waiting for interrupts to be enabled.
+static bool overflowPending;
+/// @brief  The pin change interrupt groups waiting for interrupts to be
+///         enabled, as a bit mask.
+static uint8_t pinChangePending;
+/// @brief  Whether an interrupt service routine is running.
+static bool inInterrupt;
+
+/// @brief  The mode of each pin.
+static uint8_t pinModes[HOST_PIN_COUNT];
+/// @brief  The last PWM duty cycle written to each pin.
+static int pwmValues[HOST_PIN_COUNT];
+/// @brief  The number of PWM writes to each pin.
+static unsigned long pwmWrites[HOST_PIN_COUNT];
+/// @brief  The value read from each analogue pin.
+static int analogValues[ANALOG_PIN_COUNT];
+
+/*******************************************************************************
+ * @brief   Runs an interrupt service routine, if it has been defined.
+ *
+ * @param   vector  The interrupt service routine
+ */
+static void runInterrupt(void (*vector)(void))
+{
+    if (vector != nullptr)
+    {
+        inInterrupt = true;
+        interruptsEnabled = false;
+        vector();
+        interruptsEnabled = true;
+        inInterrupt = false;
+    }
+}
+
+/*******************************************************************************
+ * @brief   Runs the pin change interrupts of the given groups, or holds them
+ *          pending if interrupts are disabled.
+ *
+ * @param   groups  The groups to run, as a bit mask
+ */
+static void raisePinChange(const uint8_t groups)
+{
+    if (!interruptsEnabled || inInterrupt)
+    {
+        pinChangePending |= groups;
+        return;
+    }
+    if (groups & _BV(0))
+    {
+        runInterrupt(PCINT0_vect);
+    }
+    if (groups & _BV(1))
+    {
+        runInterrupt(PCINT1_vect);
+    }
+    if (groups & _BV(2))
+    {
+        runInterrupt(PCINT2_vect);
+    }
+}
+
+/*******************************************************************************
+ * @brief   Runs the timer 2 overflow interrupt, or holds it pending if
+ *          interrupts are disabled.
+ */
+static void raiseOverflow()
+{
+    if (!interruptsEnabled || inInterrupt)
+    {
+        overflowPending = true;
+        return;
+    }
+    runInterrupt(TIMER2_OVF_vect);
+}
+
+/*******************************************************************************
+ * @brief   Gets the level of a pin, from its port input register.
+ *
+ * @param   pin     The pin number
+ *
+ * @return  HIGH or LOW.
+ */
+static uint8_t pinLevel(const uint8_t pin)
+{
+    return (hostPortInputs[digitalPinToPort(pin)] & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+/*******************************************************************************
+ * @brief   Sets the level of a pin in its port input register, raising its pin
+ *          change interrupt if enabled and the level has changed.
+ *
+ * @param   pin     The pin number
+ * @param   level   HIGH or LOW
+ */
+static void setPinLevel(const uint8_t pin, const uint8_t level)
+{
+    if (pin >= HOST_PIN_COUNT || pinLevel(pin) == (level ? HIGH : LOW))
+    {
+        return;
+    }
+    volatile uint8_t &port = hostPortInputs[digitalPinToPort(pin)];
+    if (level)
+    {
+        port |= digitalPinToBitMask(pin);
+    }
+    else
+    {
+        port &= ~digitalPinToBitMask(pin);
+    }
+    const uint8_t group = digitalPinToPCICRbit(pin);
+    if ((hostPcicr & _BV(group)) &&
+        (hostPcmsk[group] & _BV(digitalPinToPCMSKbit(pin))))
+    {
+        raisePinChange(_BV(group));
+    }
+}
+
+void hostReset()
+{
+    timeUs = 0;
+    nextOverflowUs = HOST_TIMER2_PERIOD_US;
+    interruptsEnabled = true;
+    overflowPending = false;
+    pinChangePending = 0;
+    inInterrupt = false;
+    memset((void *)hostPortInputs, 0, sizeof(hostPortInputs));
+    memset(pwmValues, 0, sizeof(pwmValues));
+    memset(pwmWrites, 0, sizeof(pwmWrites));
+    memset(analogValues, 0, sizeof(analogValues));
+    Serial.received.clear();
+    Serial.sent.clear();
+    EEPROM.clear();
+}
+
+void hostAdvanceUs(const unsigned long long us)
+{
+    const unsigned long long endUs = timeUs + us;
+    while (nextOverflowUs <= endUs)
+    {
+        timeUs = nextOverflowUs;
+        nextOverflowUs += HOST_TIMER2_PERIOD_US;
+        if (hostTimsk2 & _BV(TOIE2))
+        {
+            raiseOverflow();
+        }
+    }
+    timeUs = endUs;
+}
+
+void hostAdvanceMs(const unsigned long long ms)
+{
+    hostAdvanceUs(ms * 1000ULL);
+}
+
+unsigned long long hostTimeUs()
+{
+    return timeUs;
+}
+
+void hostSetInput(const uint8_t pin, const uint8_t level)
+{
+    setPinLevel(pin, level);
+}
+
+void hostSetAnalog(const uint8_t pin, const int value)
+{
+    analogValues[pin % ANALOG_PIN_COUNT] = value;
+}
+
+int hostPwm(const uint8_t pin)
+{
+    return (pin < HOST_PIN_COUNT) ? pwmValues[pin] : 0;
+}
+
+unsigned long hostPwmWrites(const uint8_t pin)
+{
+    return (pin < HOST_PIN_COUNT) ? pwmWrites[pin] : 0;
+}
+
+uint8_t hostPinMode(const uint8_t pin)
+{
+    return (pin < HOST_PIN_COUNT) ? pinModes[pin] : INPUT;
+}
+
+void hostSerialSend(const std::string &text)
+{
+    Serial.received += text;
+}
+
+std::string hostSerialTake()
+{
+    std::string text;
+    text.swap(Serial.sent);
+    return text;
+}
+
+EEPROMClass &hostEeprom()
+{
+    static EEPROMClass eeprom;
+    return eeprom;
+}
+
+/**
+ * Time
+ */
+
+unsigned long millis()
+{
+    return (unsigned long)(timeUs / 1000ULL);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)timeUs;
+}
+
+void delay(const unsigned long ms)
+{
+    hostAdvanceMs(ms);
+}
+
+void delayMicroseconds(const unsigned int us)
+{
+    hostAdvanceUs(us);
+}
+
+/**
+ * Pins
+ */
+
+void pinMode(const uint8_t pin, const uint8_t mode)
+{
+    if (pin < HOST_PIN_COUNT)
+    {
+        pinModes[pin] = mode;
+        if (mode == INPUT_PULLUP)
+        {
+            setPinLevel(pin, HIGH);
+        }
+    }
+}
+
+void digitalWrite(const uint8_t pin, const uint8_t value)
+{
+    setPinLevel(pin, value);
+    // As on the AVR, writing a pin turns off any PWM output on it
+    if (pin < HOST_PIN_COUNT)
+    {
+        pwmValues[pin] = value ? 255 : 0;
+    }
+}
+
+int digitalRead(const uint8_t pin)
+{
+    return (pin < HOST_PIN_COUNT) ? pinLevel(pin) : LOW;
+}
+
+void analogWrite(const uint8_t pin, const int value)
+{
+    if (pin < HOST_PIN_COUNT)
+    {
+        pwmValues[pin] = constrain(value, 0, 255);
+        ++pwmWrites[pin];
+    }
+}
+
+int analogRead(const uint8_t pin)
+{
+    return analogValues[pin % ANALOG_PIN_COUNT];
+}
+
+/**
+ * Interrupts
+ */
+
+void noInterrupts()
+{
+    if (!inInterrupt)
+    {
+        interruptsEnabled = false;
+    }
+}
+
+void interrupts()
+{
+    if (inInterrupt)
+    {
+        return;
+    }
+    interruptsEnabled = true;
+    if (overflowPending)
+    {
+        overflowPending = false;
+        raiseOverflow();
+    }
+    if (pinChangePending != 0)
+    {
+        const uint8_t groups = pinChangePending;
+        pinChangePending = 0;
+        raisePinChange(groups);
+    }
+}
+
+/**
+ * Serial
+ */
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+void HardwareSerial::end()
+{
+}
+
+int HardwareSerial::available()
+{
+    return (int)received.size();
+}
+
+int HardwareSerial::peek()
+{
+    return received.empty() ? -1 : (unsigned char)received[0];
+}
+
+int HardwareSerial::read()
+{
+    const int value = peek();
+    if (value >= 0)
+    {
+        received.erase(0, 1);
+    }
+    return value;
+}
+
+size_t HardwareSerial::readBytes(char *buffer, const size_t length)
+{
+    const size_t count = min(length, received.size());
+    memcpy(buffer, received.data(), count);
+    received.erase(0, count);
+    return count;
+}
+
+size_t HardwareSerial::write(const uint8_t value)
+{
+    sent += (char)value;
+    return 1;
+}
+
+size_t HardwareSerial::write(const char *text)
+{
+    return print(text);
+}
+
+size_t HardwareSerial::printNumber(unsigned long value, const int base)
+{
+    char digits[8 * sizeof(value) + 1];
+    char *digit = &digits[sizeof(digits) - 1];
+    *digit = '\0';
+    do
+    {
+        const int remainder = value % base;
+        value /= base;
+        *--digit = (remainder < 10) ? ('0' + remainder) : ('A' + remainder - 10);
+    } while (value != 0);
+    return print(digit);
+}
+
+size_t HardwareSerial::print(const __FlashStringHelper *text)
+{
+    return print(reinterpret_cast<const char *>(text));
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+    const size_t length = strlen(text);
+    sent.append(text, length);
+    return length;
+}
+
+size_t HardwareSerial::print(const char value)
+{
+    return write((uint8_t)value);
+}
+
+size_t HardwareSerial::print(const unsigned char value, const int base)
+{
+    return printNumber(value, base);
+}
+
+size_t HardwareSerial::print(const int value, const int base)
+{
+    return print((long)value, base);
+}
+
+size_t HardwareSerial::print(const unsigned int value, const int base)
+{
+    return printNumber(value, base);
+}
+
+size_t HardwareSerial::print(const long value, const int base)
+{
+    if (base == DEC && value < 0)
+    {
+        return print('-') + printNumber(-(unsigned long)value, base);
+    }
+    return printNumber((unsigned long)value, base);
+}
+
+size_t HardwareSerial::print(const unsigned long value, const int base)
+{
+    return printNumber(value, base);
+}
+
+size_t HardwareSerial::println()
+{
+    return print("\r\n");
+}
+
+size_t HardwareSerial::println(const __FlashStringHelper *text)
+{
+    return print(text) + println();
+}
+
+size_t HardwareSerial::println(const char *text)
+{
+    return print(text) + println();
+}
+
+size_t HardwareSerial::println(const char value)
+{
+    return print(value) + println();
+}
+
+size_t HardwareSerial::println(const unsigned char value, const int base)
+{
+    return print(value, base) + println();
+}
+
+size_t HardwareSerial::println(const int value, const int base)
+{
+    return print(value, base) + println();
+}
+
+size_t HardwareSerial::println(const unsigned int value, const int base)
+{
+    return print(value, base) + println();
+}
+
+size_t HardwareSerial::println(const long value, const int base)
+{
+    return print(value, base) + println();
+}
+
+size_t HardwareSerial::println(const unsigned long value, const int base)
+{
+    return print(value, base) + println();
+}
@@ -0,0 +1,115 @@
+/**
+ * @file    HostCore.h
+ *
+ * @brief   Provides the controls of the mock Arduino core, used by the host
+ *          runner and the host tests to drive the virtual hardware: moving the
+ *          virtual clock on, changing the level of the input pins, sending
+ *          serial data and reading back the PWM output of each pin.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+#include <EEPROM.h>
+
+/// @brief  The number of digital pins of the Nano, including the analogue
+///         pins used as digital pins.
+static const uint8_t HOST_PIN_COUNT = 20;
+
+/// @brief  The period of the timer 2 overflow interrupt, in microseconds. The
+///         timer runs in phase correct PWM mode with a prescaler of 64, so it
+///         overflows every 510 counts of 4us.
+static const unsigned long HOST_TIMER2_PERIOD_US = 2040;
+
+/*******************************************************************************
+ * @brief   Resets the virtual hardware between runs: the clock is set back to
+ *          zero, the EEPROM is erased, all input pins are set low, and the
+ *          serial buffers, pending interrupts and captured PWM writes are
+ *          cleared. The configuration written by the sketch (the pin modes and
+ *          the interrupt masks) is kept, as the static objects of the sketch
+ *          set it up when they are constructed, before main().
+ */
+void hostReset();
+
+/*******************************************************************************
+ * @brief   Moves the virtual clock on, running the timer 2 overflow interrupt
+ *          each time it falls due if the sketch has enabled it.
+ *
+ * @param   us  The time to move on by, in microseconds
+ */
+void hostAdvanceUs(unsigned long long us);
+
+/*******************************************************************************
+ * @brief   Moves the virtual clock on by a number of milliseconds.
+ *
+ * @param   ms  The time to move on by, in milliseconds
+ */
+void hostAdvanceMs(unsigned long long ms);
+
+/*******************************************************************************
+ * @brief   Gets the virtual time since reset.
+ *
+ * @return  The virtual time in microseconds.
+ */
+unsigned long long hostTimeUs();
+
+/*******************************************************************************
+ * @brief   Sets the level of an input pin, as if driven by a switch. If the
+ *          level changes and the pin change interrupt for the pin is enabled,
+ *          the interrupt is run.
+ *
+ * @param   pin     The pin number
+ * @param   level   HIGH or LOW
+ */
+void hostSetInput(uint8_t pin, uint8_t level);
+
+/*******************************************************************************
+ * @brief   Sets the value returned by analogRead() for a pin.
+ *
+ * @param   pin     The analogue pin number
+ * @param   value   The value, 0 to 1023
+ */
+void hostSetAnalog(uint8_t pin, int value);
+
+/*******************************************************************************
+ * @brief   Gets the PWM duty cycle last written to a pin.
+ *
+ * @param   pin     The pin number
+ *
+ * @return  The duty cycle, 0 to 255.
+ */
+int hostPwm(uint8_t pin);
+
+/*******************************************************************************
+ * @brief   Gets the number of PWM writes made to a pin since reset.
+ *
+ * @param   pin     The pin number
+ *
+ * @return  The number of writes.
+ */
+unsigned long hostPwmWrites(uint8_t pin);
+
+/*******************************************************************************
+ * @brief   Gets the mode last set for a pin.
+ *
+ * @param   pin     The pin number
+ *
+ * @return  INPUT, OUTPUT or INPUT_PULLUP.
+ */
+uint8_t hostPinMode(uint8_t pin);
+
+/*******************************************************************************
+ * @brief   Sends text to the sketch over the virtual serial port.
+ *
+ * @param   text    The text to send
+ */
+void hostSerialSend(const std::string &text);
+
+/*******************************************************************************
+ * @brief   Takes the text sent by the sketch over the virtual serial port
+ *          since the last call.
+ *
+ * @return  The text sent.
+ */
+std::string hostSerialTake();
@@ -0,0 +1,24 @@
+/**
+ * @file    pgmspace.h
+ *
+ * @brief   Provides a mock of the avr-libc program memory functions. The host
+ *          has a single address space, so data marked as held in flash is held
+ *          in memory as normal, and is read directly.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <string.h>
+
+#define PROGMEM
+
+#define pgm_read_byte(address)  (*(address))
+#define pgm_read_word(address)  (*(address))
+#define pgm_read_dword(address) (*(address))
+#define pgm_read_ptr(address)   (*(address))
+
+#define memcpy_P(destination, source, length) memcpy((destination), (source), (length))
+#define strcmp_P(a, b)                        strcmp((a), (b))
+#define strncmp_P(a, b, length)               strncmp((a), (b), (length))
+#define strlen_P(text)                        strlen(text)
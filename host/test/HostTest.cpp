@@ -0,0 +1,63 @@
+/**
+ * @file    HostTest.cpp
+ *
+ * @brief   Runs the registered host tests. See HostTest.h.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include <vector>
+
+/**
+ * A registered test.
+ */
+struct RegisteredTest
+{
+    const char *name;
+    TestFunction function;
+};
+
+/*******************************************************************************
+ * @brief   Gets the list of registered tests, created on first use as the
+ *          tests register themselves from static initialisers.
+ *
+ * @return  The registered tests.
+ */
+static std::vector<RegisteredTest> &registeredTests()
+{
+    static std::vector<RegisteredTest> tests;
+    return tests;
+}
+
+/// @brief  Whether the running test has failed.
+static bool testFailed = false;
+
+bool registerTest(const char *name, const TestFunction function)
+{
+    registeredTests().push_back(RegisteredTest{name, function});
+    return true;
+}
+
+void failTest(const char *file, const int line, const std::string &message)
+{
+    std::cout << "  " << file << ":" << line << ": " << message << std::endl;
+    testFailed = true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned failures = 0;
+    for (const RegisteredTest &test : registeredTests())
+    {
+        testFailed = false;
+        hostReset();
+        test.function();
+        std::cout << (testFailed ? "FAIL " : "ok   ") << test.name << std::endl;
+        failures += testFailed ? 1 : 0;
+    }
+    std::cout << (argc > 0 ? argv[0] : "") << ": "
+              << registeredTests().size() - failures << " passed, "
+              << failures << " failed" << std::endl;
+    return (failures == 0) ? 0 : 1;
+}
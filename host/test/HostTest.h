@@ -0,0 +1,100 @@
+/**
+ * @file    HostTest.h
+ *
+ * @brief   Provides a minimal unit test framework for the host tests. Each
+ *          test is declared with TEST(), and registers itself to be run by
+ *          the main() in HostTest.cpp. A failed check reports the file and
+ *          line, and ends the test. The virtual hardware is reset before each
+ *          test is run.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <HostCore.h>
+#include <iostream>
+#include <sstream>
+
+/// @brief  A test function.
+typedef void (*TestFunction)();
+
+/*******************************************************************************
+ * @brief   Registers a test to be run.
+ *
+ * @param   name        The name of the test
+ * @param   function    The test function
+ *
+ * @return  True, so that registration can be used as a static initialiser.
+ */
+bool registerTest(const char *name, TestFunction function);
+
+/*******************************************************************************
+ * @brief   Records a failed check of the running test.
+ *
+ * @param   file        The source file of the check
+ * @param   line        The line of the check
+ * @param   message     A description of the failure
+ */
+void failTest(const char *file, int line, const std::string &message);
+
+/*******************************************************************************
+ * @brief   Gets a value in a form that prints readably. Characters are printed
+ *          as numbers, as most are bytes.
+ *
+ * @param   value   The value
+ *
+ * @return  The value to print.
+ */
+template <typename T>
+inline const T &printable(const T &value)
+{
+    return value;
+}
+
+inline int printable(const char value)
+{
+    return value;
+}
+
+inline int printable(const signed char value)
+{
+    return value;
+}
+
+inline int printable(const unsigned char value)
+{
+    return value;
+}
+
+/// @brief  Declares and registers a test.
+#define TEST(name)                                                          \
+    static void test_##name();                                              \
+    static const bool registered_##name = registerTest(#name, &test_##name); \
+    static void test_##name()
+
+/// @brief  Checks that a condition holds, ending the test if not.
+#define CHECK(condition)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if (!(condition))                                                   \
+        {                                                                   \
+            failTest(__FILE__, __LINE__, "CHECK(" #condition ")");          \
+            return;                                                         \
+        }                                                                   \
+    } while (0)
+
+/// @brief  Checks that two values are equal, ending the test if not.
+#define CHECK_EQUAL(expected, actual)                                       \
+    do                                                                      \
+    {                                                                       \
+        const auto e_ = (expected);                                         \
+        const auto a_ = (actual);                                           \
+        if (!(e_ == a_))                                                    \
+        {                                                                   \
+            std::ostringstream message_;                                    \
+            message_ << "CHECK_EQUAL(" #expected ", " #actual "): expected " \
+                     << printable(e_) << ", got " << printable(a_);      \
+            failTest(__FILE__, __LINE__, message_.str());                   \
+            return;                                                         \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,77 @@
+/**
+ * @file    TestCluster.h
+ *
+ * @brief   Provides an LED cluster wired as in the sketch, for the host tests,
+ *          and helpers to run it on the virtual clock.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include "HostTest.h"
+#include "LedCluster.h"
+
+/// @brief  An LED cluster on the display LED pins of the sketch, begun as
+///         soon as it is constructed, as the mock core needs no set up.
+class TestCluster : public LedCluster<
+    NanoBoard,
+    Pins::DisplayLED1,
+    Pins::DisplayLED2,
+    Pins::DisplayLED3,
+    Pins::DisplayLED4,
+    Pins::DisplayLED5,
+    Pins::DisplayLED6
+>
+{
+public:
+    TestCluster()
+    {
+        begin();
+    }
+};
+
+/// @brief  The pins of the test cluster, in order around the circle.
+static const uint8_t TEST_CLUSTER_PINS[] =
+{
+    Pins::DisplayLED1,
+    Pins::DisplayLED2,
+    Pins::DisplayLED3,
+    Pins::DisplayLED4,
+    Pins::DisplayLED5,
+    Pins::DisplayLED6
+};
+
+/// @brief  The time between polls of the cluster, in microseconds.
+static const unsigned long TEST_POLL_STEP_US = 100;
+
+/*******************************************************************************
+ * @brief   Polls a cluster for a length of virtual time, as the sketch loop
+ *          does.
+ *
+ * @param   cluster     The cluster
+ * @param   durationMs  The time to run for, in milliseconds
+ */
+inline void runCluster(TestCluster &cluster, const unsigned long durationMs)
+{
+    const unsigned long long endUs = hostTimeUs() + durationMs * 1000ULL;
+    while (hostTimeUs() < endUs)
+    {
+        cluster.poll();
+        hostAdvanceUs(TEST_POLL_STEP_US);
+    }
+}
+
+/*******************************************************************************
+ * @brief   Gets the number of frames a cluster has drawn since its frame
+ *          statistics were last reset.
+ *
+ * @param   cluster     The cluster
+ *
+ * @return  The number of frames.
+ */
+inline unsigned long framesDrawn(const TestCluster &cluster)
+{
+    FrameStats stats;
+    cluster.getFrameStats(&stats);
+    return stats.count;
+}
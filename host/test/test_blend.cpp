@@ -0,0 +1,144 @@
+/**
+ * @file    test_blend.cpp
+ *
+ * @brief   Tests the blend modes of the pattern layers, for every pair of
+ *          levels, and a layer blended over the main pattern of a cluster.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "TestCluster.h"
+#include <math.h>
+
+/*******************************************************************************
+ * @brief   Blends a single layer level over a single level.
+ *
+ * @param   below   The level beneath the layer
+ * @param   above   The level of the layer
+ * @param   mode    The BlendMode
+ * @param   opacity The opacity, from 0 to 256
+ *
+ * @return  The blended level.
+ */
+static int blend(const byte below, const byte above, const byte mode, const uint16_t opacity = 256)
+{
+    byte level = below;
+    PatternContext context = PatternContext();
+    context.levels = &level;
+    context.count = 1;
+    blendLevels(context, &above, mode, opacity);
+    return level;
+}
+
+/*******************************************************************************
+ * @brief   Gets the product of two percentages, rounded to the nearest.
+ *
+ * @param   a   The first percentage
+ * @param   b   The second percentage
+ *
+ * @return  The product as a percentage.
+ */
+static int product(const int a, const int b)
+{
+    return (int)floor((a * b) / 100.0 + 0.5);
+}
+
+TEST(add_saturates_at_full_brightness)
+{
+    for (int below = 0; below <= 100; ++below)
+    {
+        for (int above = 0; above <= 100; ++above)
+        {
+            CHECK_EQUAL(min(below + above, 100), blend(below, above, BLEND_ADD));
+        }
+    }
+}
+
+TEST(max_takes_the_brighter_level)
+{
+    for (int below = 0; below <= 100; ++below)
+    {
+        for (int above = 0; above <= 100; ++above)
+        {
+            CHECK_EQUAL(max(below, above), blend(below, above, BLEND_MAX));
+        }
+    }
+}
+
+TEST(multiply_only_darkens)
+{
+    for (int below = 0; below <= 100; ++below)
+    {
+        for (int above = 0; above <= 100; ++above)
+        {
+            const int level = blend(below, above, BLEND_MULTIPLY);
+            CHECK_EQUAL(product(below, above), level);
+            CHECK(level <= min(below, above));
+        }
+        CHECK_EQUAL(below, blend(below, 100, BLEND_MULTIPLY));
+        CHECK_EQUAL(0, blend(below, 0, BLEND_MULTIPLY));
+    }
+}
+
+TEST(screen_only_brightens)
+{
+    for (int below = 0; below <= 100; ++below)
+    {
+        for (int above = 0; above <= 100; ++above)
+        {
+            const int level = blend(below, above, BLEND_SCREEN);
+            CHECK_EQUAL(100 - product(100 - below, 100 - above), level);
+            CHECK(level >= max(below, above));
+        }
+        CHECK_EQUAL(below, blend(below, 0, BLEND_SCREEN));
+        CHECK_EQUAL(100, blend(below, 100, BLEND_SCREEN));
+    }
+}
+
+TEST(opacity_weights_the_blend)
+{
+    for (byte mode = BLEND_OFF; mode < BLEND_MODE_COUNT; ++mode)
+    {
+        for (int below = 0; below <= 100; below += 5)
+        {
+            for (int above = 0; above <= 100; above += 5)
+            {
+                const int blended = blend(below, above, mode);
+                CHECK_EQUAL(below, blend(below, above, mode, 0));
+                CHECK_EQUAL((below + blended + 1) / 2, blend(below, above, mode, 128));
+            }
+            // Nothing is drawn with the layer off
+            CHECK_EQUAL(below, blend(below, 100 - below, BLEND_OFF));
+        }
+    }
+}
+
+TEST(layer_is_blended_over_the_main_pattern)
+{
+    TestCluster cluster;
+    cluster.setBrightnessPercent(100);
+    cluster.setTransitionTime(0);
+    cluster.setPattern(Patterns::JustOn);
+    runCluster(cluster, 500);
+    const int fullDuty = hostPwm(TEST_CLUSTER_PINS[0]);
+    cluster.setPattern(Patterns::ChaseClockwise);
+    runCluster(cluster, 500);
+    // An opaque Just On layer, taking the brighter level, lights every LED
+    LayerSettings layer = { Patterns::JustOn, BLEND_MAX, 100, DEFAULT_SPEED };
+    CHECK(cluster.setLayer(0, layer));
+    runCluster(cluster, 100);
+    for (const uint8_t pin : TEST_CLUSTER_PINS)
+    {
+        CHECK_EQUAL(fullDuty, hostPwm(pin));
+    }
+    // Multiplying by it leaves the chase as it was, with some LEDs dim
+    layer.blend = BLEND_MULTIPLY;
+    CHECK(cluster.setLayer(0, layer));
+    runCluster(cluster, 100);
+    int dimmest = fullDuty;
+    for (const uint8_t pin : TEST_CLUSTER_PINS)
+    {
+        dimmest = min(dimmest, hostPwm(pin));
+    }
+    CHECK(dimmest < fullDuty / 2);
+}
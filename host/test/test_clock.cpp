@@ -0,0 +1,206 @@
+/**
+ * @file    test_clock.cpp
+ *
+ * @brief   Tests the pattern clock, the phase accumulator giving the position
+ *          of the lead point of a pattern, against the floating point angle
+ *          it replaced.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "TestCluster.h"
+#include <math.h>
+
+/// @brief  Speeds to test, in revolutions per minute. 7 and 70 do not divide
+///         a minute into a whole number of milliseconds.
+static const int TEST_SPEEDS[] = { 1, 7, 10, 25, 60, 70, 100 };
+
+/// @brief  The time between frames, in milliseconds.
+static const unsigned long FRAME_MS = 20;
+
+/*******************************************************************************
+ * @brief   Gets the angle of the lead point as the floating point clock did,
+ *          from the time since the pattern started. The period was truncated
+ *          to whole milliseconds.
+ *
+ * @param   elapsedMs       The time since the pattern started
+ * @param   revsPerMinute   The speed
+ *
+ * @return  The angle in degrees.
+ */
+static float floatAngle(const unsigned long long elapsedMs, const int revsPerMinute)
+{
+    const long revTimePeriodMs = (1000.0f * 60.0f) / revsPerMinute;
+    return (360.0f * (elapsedMs % revTimePeriodMs)) / revTimePeriodMs;
+}
+
+/*******************************************************************************
+ * @brief   Gets the exact angle of the lead point, from the time since the
+ *          pattern started.
+ *
+ * @param   elapsedMs       The time since the pattern started
+ * @param   revsPerMinute   The speed
+ *
+ * @return  The angle in degrees.
+ */
+static double exactAngle(const unsigned long long elapsedMs, const int revsPerMinute)
+{
+    const unsigned long long sixtieths = elapsedMs * revsPerMinute % MS_PER_MINUTE;
+    return 360.0 * sixtieths / MS_PER_MINUTE;
+}
+
+/*******************************************************************************
+ * @brief   Gets the difference between two angles, the short way round.
+ *
+ * @param   a   The first angle in degrees
+ * @param   b   The second angle in degrees
+ *
+ * @return  The difference in degrees, 0 to 180.
+ */
+static double angleDifference(const double a, const double b)
+{
+    const double difference = fmod(fabs(a - b), 360.0);
+    return (difference > 180.0) ? 360.0 - difference : difference;
+}
+
+/*******************************************************************************
+ * @brief   Gets the angle of a clock from its phase accumulator.
+ *
+ * @param   clock   The clock
+ *
+ * @return  The angle in degrees.
+ */
+static double clockAngle(const PatternClock &clock)
+{
+    return 360.0 * clock.phaseAccumulator / 4294967296.0;
+}
+
+/*******************************************************************************
+ * @brief   Starts a clock from the beginning at a speed.
+ *
+ * @param   clock           The clock
+ * @param   revsPerMinute   The speed
+ */
+static void startClock(PatternClock &clock, const int revsPerMinute)
+{
+    resetClock(clock);
+    setClockSpeed(clock, revsPerMinute);
+}
+
+TEST(angle_matches_the_float_clock)
+{
+    PatternContext context;
+    for (const int rpm : TEST_SPEEDS)
+    {
+        PatternClock clock;
+        startClock(clock, rpm);
+        // Ten minutes of frames, with the interval varying as it does on the
+        // device
+        unsigned long long timeMs = 0;
+        for (unsigned long frame = 0; timeMs < 10 * MS_PER_MINUTE; ++frame)
+        {
+            const unsigned long elapsedMs = FRAME_MS - 1 + frame % 3;
+            timeMs += elapsedMs;
+            advanceClock(clock, elapsedMs, context);
+            // The float clock's period was truncated to whole milliseconds,
+            // so it ran slightly fast at speeds not dividing a minute, and is
+            // only compared over the first revolution at those speeds
+            if (MS_PER_MINUTE % rpm == 0 || timeMs * rpm < MS_PER_MINUTE)
+            {
+                // The angle is truncated to whole degrees, as the kernels
+                // truncated the float angle, and the float clock's period
+                // error adds up to a few hundredths of a degree
+                CHECK(angleDifference(context.angle, floatAngle(timeMs, rpm)) < 1.05);
+            }
+            CHECK(angleDifference(clockAngle(clock), exactAngle(timeMs, rpm)) < 0.001);
+            CHECK_EQUAL((long)(timeMs * rpm / MS_PER_MINUTE), clock.revolution);
+        }
+    }
+}
+
+TEST(clock_does_not_drift)
+{
+    PatternContext context;
+    for (const int rpm : TEST_SPEEDS)
+    {
+        PatternClock clock;
+        startClock(clock, rpm);
+        // A week of frames
+        static const unsigned long long WEEK_MS = 7ULL * 24 * 60 * MS_PER_MINUTE;
+        unsigned long long timeMs = 0;
+        while (timeMs < WEEK_MS)
+        {
+            advanceClock(clock, FRAME_MS + 1, context);
+            timeMs += FRAME_MS + 1;
+        }
+        CHECK(angleDifference(clockAngle(clock), exactAngle(timeMs, rpm)) < 0.001);
+        CHECK_EQUAL((long)(timeMs * rpm / MS_PER_MINUTE), clock.revolution);
+    }
+}
+
+TEST(stall_lands_where_steady_frames_would)
+{
+    PatternContext context;
+    for (const int rpm : TEST_SPEEDS)
+    {
+        PatternClock steady;
+        PatternClock stalled;
+        startClock(steady, rpm);
+        startClock(stalled, rpm);
+        for (unsigned long stallMs = 1; stallMs < 10 * MS_PER_MINUTE; stallMs = stallMs * 3 + 7)
+        {
+            for (unsigned long ms = 0; ms < stallMs; ms += 10)
+            {
+                advanceClock(steady, min(10UL, stallMs - ms), context);
+            }
+            const bool newRevolution = advanceClock(stalled, stallMs, context);
+            CHECK_EQUAL(steady.phaseAccumulator, stalled.phaseAccumulator);
+            CHECK_EQUAL(steady.revolution, stalled.revolution);
+            CHECK_EQUAL(steady.revolution, context.revolution);
+            CHECK_EQUAL(stallMs * rpm >= MS_PER_MINUTE, newRevolution);
+        }
+    }
+}
+
+TEST(speed_change_continues_from_the_same_angle)
+{
+    PatternContext context;
+    PatternClock clock;
+    startClock(clock, 30);
+    advanceClock(clock, 500, context);
+    const uint16_t phase = context.phase;
+    for (const int rpm : TEST_SPEEDS)
+    {
+        setClockSpeed(clock, rpm);
+        advanceClock(clock, 0, context);
+        CHECK_EQUAL(phase, context.phase);
+    }
+    // Then carries on at the new speed: a quarter turn at 60rpm is 250ms
+    setClockSpeed(clock, 60);
+    const double before = clockAngle(clock);
+    advanceClock(clock, 250, context);
+    CHECK(angleDifference(clockAngle(clock), before + 90.0) < 0.001);
+}
+
+TEST(clock_is_continuous_across_millis_rollover)
+{
+    // The elapsed time is the difference of two readings of millis(), which
+    // on the AVR is 32 bits and rolls over after 49.7 days. The host's
+    // unsigned long is 64 bits, so the subtraction is done in 32 bits here.
+    PatternContext context;
+    PatternClock clock;
+    startClock(clock, 60);
+    uint32_t lastMs = 0xFFFFFFFFUL - 5 * FRAME_MS;
+    double expected = 0.0;
+    for (int frame = 0; frame < 10; ++frame)
+    {
+        const uint32_t nowMs = lastMs + FRAME_MS;
+        const uint32_t elapsedMs = nowMs - lastMs;
+        lastMs = nowMs;
+        advanceClock(clock, elapsedMs, context);
+        expected += 360.0 * FRAME_MS / 1000.0;
+        CHECK_EQUAL(FRAME_MS, (unsigned long)elapsedMs);
+        CHECK(angleDifference(clockAngle(clock), expected) < 0.001);
+    }
+    CHECK(lastMs < 0xFFFFFFFFUL - 5 * FRAME_MS);
+}
@@ -0,0 +1,159 @@
+/**
+ * @file    test_crossfade.cpp
+ *
+ * @brief   Tests the crossfade from one pattern to the next when the pattern
+ *          is changed, through the duty cycles written to the LED outputs.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "TestCluster.h"
+
+/// @brief  The number of LEDs in the test cluster.
+static const int LED_COUNT = sizeof(TEST_CLUSTER_PINS);
+
+/// @brief  The longest time for a change to reach the outputs: the frame it
+///         is drawn in, then the tick it is committed on.
+static const unsigned long FRAME_LATENCY_MS = 45;
+
+/*******************************************************************************
+ * @brief   Starts a cluster at full brightness showing Just On, with no
+ *          crossfade.
+ *
+ * @param   cluster     The cluster
+ *
+ * @return  The duty cycle of an LED that is fully on.
+ */
+static int startFullyOn(TestCluster &cluster)
+{
+    cluster.setBrightnessPercent(100);
+    cluster.setTransitionTime(0);
+    cluster.setPattern(Patterns::JustOn);
+    runCluster(cluster, 500);
+    return hostPwm(TEST_CLUSTER_PINS[0]);
+}
+
+/*******************************************************************************
+ * @brief   Gets the lowest duty cycle written to the LEDs.
+ *
+ * @return  The lowest duty cycle.
+ */
+static int dimmestDuty()
+{
+    int dimmest = hostPwm(TEST_CLUSTER_PINS[0]);
+    for (int i = 1; i < LED_COUNT; ++i)
+    {
+        dimmest = min(dimmest, hostPwm(TEST_CLUSTER_PINS[i]));
+    }
+    return dimmest;
+}
+
+/*******************************************************************************
+ * @brief   Checks whether every LED is written with a duty cycle.
+ *
+ * @param   duty    The duty cycle
+ *
+ * @return  True if every LED has the duty cycle, false otherwise.
+ */
+static bool allAtDuty(const int duty)
+{
+    for (int i = 0; i < LED_COUNT; ++i)
+    {
+        if (hostPwm(TEST_CLUSTER_PINS[i]) != duty)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(crossfade_mix_runs_from_outgoing_to_incoming)
+{
+    byte from[LED_COUNT] = { 0, 20, 40, 60, 80, 100 };
+    byte levels[LED_COUNT];
+    PatternContext context = PatternContext();
+    context.levels = levels;
+    context.count = LED_COUNT;
+    for (unsigned int mix = 0; mix <= 256; ++mix)
+    {
+        memset(levels, 50, sizeof(levels));
+        crossfadeLevels(context, from, mix);
+        for (int i = 0; i < LED_COUNT; ++i)
+        {
+            const int expected = (from[i] * (256 - mix) + 50 * mix + 128) / 256;
+            CHECK_EQUAL(expected, (int)levels[i]);
+        }
+        if (mix == 0)
+        {
+            CHECK(memcmp(levels, from, sizeof(levels)) == 0);
+        }
+    }
+    for (int i = 0; i < LED_COUNT; ++i)
+    {
+        CHECK_EQUAL(50, (int)levels[i]);
+    }
+}
+
+TEST(crossfade_starts_at_the_outgoing_levels)
+{
+    TestCluster cluster;
+    const int fullDuty = startFullyOn(cluster);
+    CHECK(fullDuty > 0);
+    cluster.setTransitionTime(2000);
+    cluster.setPattern(Patterns::ChaseClockwise);
+    runCluster(cluster, FRAME_LATENCY_MS);
+    // At most a few frames in, Just On still outweighs the chase
+    CHECK(dimmestDuty() >= fullDuty * 9 / 10);
+    runCluster(cluster, 2000);
+    CHECK(dimmestDuty() < fullDuty / 2);
+}
+
+TEST(crossfade_ends_at_the_incoming_levels)
+{
+    TestCluster cluster;
+    const int fullDuty = startFullyOn(cluster);
+    cluster.setPattern(Patterns::ChaseClockwise);
+    runCluster(cluster, 500);
+    cluster.setTransitionTime(500);
+    cluster.setPattern(Patterns::JustOn);
+    runCluster(cluster, 400);
+    CHECK(dimmestDuty() < fullDuty);
+    runCluster(cluster, 100 + FRAME_LATENCY_MS);
+    CHECK(allAtDuty(fullDuty));
+    runCluster(cluster, 500);
+    CHECK(allAtDuty(fullDuty));
+}
+
+TEST(zero_duration_cuts_straight_to_the_new_pattern)
+{
+    TestCluster cluster;
+    const int fullDuty = startFullyOn(cluster);
+    cluster.setPattern(Patterns::ChaseClockwise);
+    runCluster(cluster, 500);
+    CHECK(dimmestDuty() < fullDuty / 2);
+    cluster.setPattern(Patterns::JustOn);
+    runCluster(cluster, FRAME_LATENCY_MS);
+    CHECK(allAtDuty(fullDuty));
+}
+
+TEST(pattern_change_mid_fade_carries_on_from_the_blend)
+{
+    TestCluster cluster;
+    const int fullDuty = startFullyOn(cluster);
+    cluster.setTransitionTime(2000);
+    cluster.setPattern(Patterns::ChaseClockwise);
+    runCluster(cluster, 1000);
+    // Half way from Just On to the chase, which on its own would leave some
+    // LEDs close to off
+    const int blendedDuty = dimmestDuty();
+    CHECK(blendedDuty < fullDuty);
+    CHECK(blendedDuty > fullDuty / 4);
+    cluster.setPattern(Patterns::JustOn);
+    runCluster(cluster, FRAME_LATENCY_MS);
+    // The blend is faded out from where it was, rather than the chase alone
+    CHECK(dimmestDuty() >= blendedDuty * 9 / 10);
+    runCluster(cluster, 1900);
+    CHECK(dimmestDuty() < fullDuty);
+    runCluster(cluster, 100 + FRAME_LATENCY_MS);
+    CHECK(allAtDuty(fullDuty));
+}
@@ -0,0 +1,88 @@
+/**
+ * @file    test_flames.cpp
+ *
+ * @brief   Tests the flames pattern over a long run: that it averages out at
+ *          its base level, as the README promises, and never goes out or
+ *          clips at full brightness.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "PatternKernels.h"
+#include <math.h>
+#include <stdio.h>
+
+/// @brief  The number of LEDs drawn.
+static const byte LED_COUNT = 6;
+
+/*******************************************************************************
+ * @brief   Gets the furthest the flicker bands together can move the level
+ *          from the base level, either way.
+ *
+ * @return  The swing as a percentage.
+ */
+static int flameSwing()
+{
+    FlickerBand bands[FLAME_BAND_COUNT];
+    memcpy_P(bands, FLAME_BANDS, sizeof(bands));
+    int swing = 0;
+    for (const FlickerBand &band : bands)
+    {
+        swing += (band.amplitude * 255) / 256;
+    }
+    return swing;
+}
+
+TEST(flames_average_out_at_the_base_level)
+{
+    uint16_t ledPhases[LED_COUNT];
+    int extras[LED_COUNT];
+    byte levels[LED_COUNT];
+    FastRandom rng;
+    PatternContext context = PatternContext();
+    for (byte i = 0; i < LED_COUNT; ++i)
+    {
+        ledPhases[i] = ((unsigned long)i << 16) / LED_COUNT;
+    }
+    context.count = LED_COUNT;
+    context.ledPhases = ledPhases;
+    context.extras = extras;
+    context.levels = levels;
+    context.rng = &rng;
+    seedFlames(context);
+
+    // 65536 revolutions, long enough for the slowest band to cover the whole
+    // of its noise many times over
+    const uint32_t step = 0x3FF;
+    uint64_t sums[LED_COUNT] = { 0 };
+    int lowest = 100;
+    int highest = 0;
+    uint32_t frames = 0;
+    for (uint32_t time = 0; time <= UINT32_MAX - step; time += step)
+    {
+        context.revolution = time >> 16;
+        context.phase = time & 0xFFFF;
+        drawFlames(context);
+        for (byte i = 0; i < LED_COUNT; ++i)
+        {
+            sums[i] += levels[i];
+            lowest = min(lowest, (int)levels[i]);
+            highest = max(highest, (int)levels[i]);
+        }
+        ++frames;
+    }
+
+    printf("  mean level per LED (%%):");
+    for (byte i = 0; i < LED_COUNT; ++i)
+    {
+        const double mean = (double)sums[i] / frames;
+        printf(" %.3f", mean);
+        CHECK(fabs(mean - FLAME_BASE_LEVEL) < 0.1);
+    }
+    printf("\n  levels from %d to %d\n", lowest, highest);
+    CHECK(lowest >= FLAME_BASE_LEVEL - flameSwing());
+    CHECK(highest <= FLAME_BASE_LEVEL + flameSwing());
+    CHECK(lowest > 0);
+    CHECK(highest < 100);
+}
@@ -0,0 +1,346 @@
+/**
+ * @file    test_golden.cpp
+ *
+ * @brief   Tests that the patterns are drawn as they were, by comparing the
+ *          pattern traces of the sketch against the golden traces checked in
+ *          to golden/, one file per pattern. Run "make golden" to rewrite the
+ *          golden traces after a change that is meant to alter how a pattern
+ *          looks, and check the differences in before committing them.
+ *
+ *          A duty cycle matches if it is within one step of the brightness to
+ *          duty cycle table of the golden duty cycle, so that rounding changes
+ *          pass but anything that can be seen does not.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "TestCluster.h"
+#include "sketch_nuka_cola.ino"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <vector>
+
+/// @brief  The directory holding the golden traces, from the host directory.
+static const char GOLDEN_DIR[] = "golden/";
+
+/// @brief  Set to rewrite the golden traces rather than compare against them.
+static const char GOLDEN_UPDATE_VARIABLE[] = "GOLDEN_UPDATE";
+
+/// @brief  The most differing frames reported for each pattern.
+static const unsigned int MAX_REPORTED_FRAMES = 4;
+
+/// @brief  The number of LEDs traced.
+static const int TRACE_LED_COUNT = 6;
+
+/// @brief  A whole number of milliseconds that is also a whole number of
+///         frames, so runs this far apart see the frame tick at the same time.
+static const unsigned long FRAME_ALIGNED_MS = 102;
+
+/// @brief  The frames of the pattern being traced, LED by LED.
+static std::vector<int> tracedDuties;
+
+/*******************************************************************************
+ * @brief   Adds a traced frame to the traced duty cycles.
+ *
+ * @param   pattern     The pattern index traced
+ * @param   frame       The frame number
+ * @param   dutyCycles  The duty cycle of each LED
+ * @param   count       The number of LEDs
+ */
+static void recordTraceFrame(
+    const int pattern,
+    const unsigned int frame,
+    const byte * const dutyCycles,
+    const int count
+)
+{
+    tracedDuties.insert(tracedDuties.end(), dutyCycles, dutyCycles + count);
+}
+
+/*******************************************************************************
+ * @brief   Gets the golden trace file of a pattern, named after the pattern
+ *          so that the files do not depend on which patterns are built in.
+ *
+ * @param   pattern     The pattern index
+ *
+ * @return  The path of the golden trace.
+ */
+static std::string goldenPath(const int pattern)
+{
+    std::string name(reinterpret_cast<const char *>(getPatternName(pattern)));
+    for (char &c : name)
+    {
+        c = (c == ' ') ? '_' : tolower(c);
+    }
+    return GOLDEN_DIR + name + ".csv";
+}
+
+/*******************************************************************************
+ * @brief   Writes a trace as comma separated values, with a header line, then
+ *          the frame number and the duty cycle of each LED on each line.
+ *
+ * @param   path    The file to write
+ * @param   duties  The duty cycles, LED by LED, for each frame
+ *
+ * @return  True if the file was written.
+ */
+static bool writeTrace(const std::string &path, const std::vector<int> &duties)
+{
+    std::ofstream file(path.c_str());
+    file << "frame";
+    for (int led = 0; led < TRACE_LED_COUNT; ++led)
+    {
+        file << ",led" << (led + 1);
+    }
+    file << "\n";
+    for (size_t frame = 0; frame * TRACE_LED_COUNT < duties.size(); ++frame)
+    {
+        file << frame;
+        for (int led = 0; led < TRACE_LED_COUNT; ++led)
+        {
+            file << "," << duties[(frame * TRACE_LED_COUNT) + led];
+        }
+        file << "\n";
+    }
+    return file.good();
+}
+
+/*******************************************************************************
+ * @brief   Reads a trace written by writeTrace().
+ *
+ * @param   path    The file to read
+ * @param   duties  Set to the duty cycles, LED by LED, for each frame
+ *
+ * @return  True if the file was read.
+ */
+static bool readTrace(const std::string &path, std::vector<int> &duties)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    if (!std::getline(file, line))
+    {
+        return false;
+    }
+    duties.clear();
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string field;
+        // Skip the frame number
+        std::getline(fields, field, ',');
+        while (std::getline(fields, field, ','))
+        {
+            duties.push_back(atoi(field.c_str()));
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * @brief   Gets the brightness level with a given duty cycle.
+ *
+ * @param   duty    The duty cycle
+ *
+ * @return  The brightness level, or -1 if no level has the duty cycle.
+ */
+static int dutyLevel(const int duty)
+{
+    for (int level = 0; level <= MAX_BRIGHTNESS_PCT; ++level)
+    {
+        if (BRIGHTNESS_TO_DUTY_CYCLE[level] == duty)
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+/*******************************************************************************
+ * @brief   Checks whether a duty cycle is within one brightness level of the
+ *          golden duty cycle.
+ *
+ * @param   golden  The golden duty cycle
+ * @param   actual  The duty cycle traced
+ *
+ * @return  True if they match.
+ */
+static bool dutyMatches(const int golden, const int actual)
+{
+    const int goldenLevel = dutyLevel(golden);
+    const int actualLevel = dutyLevel(actual);
+    if (goldenLevel < 0 || actualLevel < 0)
+    {
+        return golden == actual;
+    }
+    return abs(goldenLevel - actualLevel) <= 1;
+}
+
+/*******************************************************************************
+ * @brief   Gets the duty cycles of a frame as a line of hex, as the "trace"
+ *          serial command prints them.
+ *
+ * @param   duties  The duty cycles, LED by LED, for each frame
+ * @param   frame   The frame number
+ *
+ * @return  The duty cycles of the frame.
+ */
+static std::string frameHex(const std::vector<int> &duties, const size_t frame)
+{
+    std::string hex;
+    for (int led = 0; led < TRACE_LED_COUNT; ++led)
+    {
+        const size_t index = (frame * TRACE_LED_COUNT) + led;
+        char digits[4];
+        snprintf(digits, sizeof(digits), " %02X",
+                 (index < duties.size()) ? duties[index] : 0);
+        hex += (index < duties.size()) ? digits : " --";
+    }
+    return hex;
+}
+
+/*******************************************************************************
+ * @brief   Compares a trace against its golden trace, printing a short report
+ *          of the frames that differ.
+ *
+ * @param   pattern The pattern index
+ * @param   golden  The golden duty cycles
+ * @param   traced  The traced duty cycles
+ *
+ * @return  The number of duty cycles that do not match.
+ */
+static unsigned int compareTrace(
+    const int pattern,
+    const std::vector<int> &golden,
+    const std::vector<int> &traced
+)
+{
+    const size_t size = max(golden.size(), traced.size());
+    unsigned int differences = 0;
+    unsigned int reported = 0;
+    for (size_t frame = 0; frame * TRACE_LED_COUNT < size; ++frame)
+    {
+        bool frameDiffers = false;
+        for (int led = 0; led < TRACE_LED_COUNT; ++led)
+        {
+            const size_t index = (frame * TRACE_LED_COUNT) + led;
+            if (index >= golden.size() || index >= traced.size() ||
+                !dutyMatches(golden[index], traced[index]))
+            {
+                ++differences;
+                frameDiffers = true;
+            }
+        }
+        if (frameDiffers && reported++ < MAX_REPORTED_FRAMES)
+        {
+            printf("  %s frame %zu: golden%s, traced%s\n",
+                   goldenPath(pattern).c_str(), frame,
+                   frameHex(golden, frame).c_str(),
+                   frameHex(traced, frame).c_str());
+        }
+    }
+    if (differences > 0)
+    {
+        printf("  %s: %u of %zu duty cycles differ by more than a step\n",
+               goldenPath(pattern).c_str(), differences, size);
+    }
+    return differences;
+}
+
+TEST(patterns_match_their_golden_traces)
+{
+    const bool update = getenv(GOLDEN_UPDATE_VARIABLE) != nullptr;
+    CHECK_EQUAL(TRACE_LED_COUNT, cluster.getLedCount());
+    unsigned int differing = 0;
+    for (int pattern = 0; pattern < Patterns::PATTERN_COUNT; ++pattern)
+    {
+        tracedDuties.clear();
+        cluster.tracePattern(
+            pattern,
+            TRACE_SEED,
+            TRACE_FRAMES_PER_REVOLUTION * TRACE_REVOLUTIONS,
+            TRACE_FRAMES_PER_REVOLUTION,
+            recordTraceFrame
+        );
+        const std::string path = goldenPath(pattern);
+        if (update)
+        {
+            CHECK(writeTrace(path, tracedDuties));
+            printf("  wrote %s\n", path.c_str());
+            continue;
+        }
+        std::vector<int> golden;
+        if (!readTrace(path, golden))
+        {
+            printf("  %s: missing, run \"make golden\" to write it\n", path.c_str());
+            ++differing;
+        }
+        else if (compareTrace(pattern, golden, tracedDuties) > 0)
+        {
+            ++differing;
+        }
+    }
+    CHECK_EQUAL(0u, differing);
+}
+
+TEST(duty_within_a_step_matches)
+{
+    CHECK(dutyMatches(0, 0));
+    CHECK(dutyMatches(0, 1));
+    CHECK(!dutyMatches(0, 2));
+    CHECK(dutyMatches(229, 221));
+    CHECK(dutyMatches(229, 237));
+    CHECK(!dutyMatches(229, 214));
+    CHECK(dutyMatches(255, 245));
+    CHECK(!dutyMatches(255, 237));
+    // Duty cycles that no level has must match exactly
+    CHECK(dutyMatches(11, 11));
+    CHECK(!dutyMatches(11, 10));
+}
+
+TEST(trace_leaves_the_running_pattern_alone)
+{
+    const Patterns patterns[] =
+    {
+        Patterns::Raindrop, Patterns::Flames, Patterns::Static,
+        Patterns::Drops, Patterns::Comets, Patterns::Sparks
+    };
+    for (const Patterns pattern : patterns)
+    {
+        TestCluster running;
+        running.setBrightnessPercent(100);
+        running.setTransitionTime(0);
+        running.setPattern(pattern);
+        running.setRandomSeed(1234);
+        runCluster(running, FRAME_ALIGNED_MS * 5);
+        std::vector<int> untraced;
+        for (unsigned long ms = 0; ms < FRAME_ALIGNED_MS * 10; ++ms)
+        {
+            runCluster(running, 1);
+            for (const uint8_t pin : TEST_CLUSTER_PINS)
+            {
+                untraced.push_back(hostPwm(pin));
+            }
+        }
+        // The same again, tracing a random pattern part way through
+        running.setRandomSeed(1234);
+        runCluster(running, FRAME_ALIGNED_MS * 5);
+        running.tracePattern(
+            Patterns::Sparks,
+            TRACE_SEED,
+            TRACE_FRAMES_PER_REVOLUTION,
+            TRACE_FRAMES_PER_REVOLUTION,
+            recordTraceFrame
+        );
+        std::vector<int> traced;
+        for (unsigned long ms = 0; ms < FRAME_ALIGNED_MS * 10; ++ms)
+        {
+            runCluster(running, 1);
+            for (const uint8_t pin : TEST_CLUSTER_PINS)
+            {
+                traced.push_back(hostPwm(pin));
+            }
+        }
+        CHECK(untraced == traced);
+    }
+}
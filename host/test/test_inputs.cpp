@@ -0,0 +1,310 @@
+/**
+ * @file    test_inputs.cpp
+ *
+ * @brief   Tests the de-bouncing of the button inputs.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "InputHelper.h"
+#include <vector>
+
+/// @brief  The pin the test button is on.
+static const uint8_t BUTTON_PIN = 12;
+
+/// @brief  A toggle callback received from an input.
+struct Toggle
+{
+    int state;
+    unsigned long timeMs;
+};
+
+/// @brief  The toggle callbacks received by the test button.
+static std::vector<Toggle> toggles;
+
+/*******************************************************************************
+ * @brief   Records a toggle of the test button.
+ */
+static void buttonToggled(const int, const int state, const long)
+{
+    toggles.push_back(Toggle{state, millis()});
+}
+
+/*******************************************************************************
+ * @brief   Polls an input every millisecond for a length of virtual time,
+ *          checking that no poll blocks.
+ *
+ * @param   input       The input to poll
+ * @param   durationMs  The time to run for, in milliseconds
+ * @param   periodMs    The time between polls, in milliseconds
+ *
+ * @return  True if no poll moved the virtual time on, false otherwise.
+ */
+static bool pollFor(InputHelper &input, const unsigned long durationMs, const unsigned long periodMs = 1)
+{
+    bool blocked = false;
+    for (unsigned long ms = 0; ms < durationMs; ms += periodMs)
+    {
+        const unsigned long long beforeUs = hostTimeUs();
+        input.poll();
+        blocked |= (hostTimeUs() != beforeUs);
+        hostAdvanceMs(periodMs);
+    }
+    return !blocked;
+}
+
+/*******************************************************************************
+ * @brief   Bounces the test button, changing its level every given interval
+ *          whilst polling it, before leaving it at the given level.
+ *
+ * @param   input       The input to poll
+ * @param   bounces     The number of level changes
+ * @param   intervalMs  The time between level changes, in milliseconds
+ * @param   finalLevel  The level to leave the button at
+ */
+static void bounce(InputHelper &input, const int bounces, const unsigned long intervalMs, const uint8_t finalLevel)
+{
+    for (int i = 0; i < bounces; ++i)
+    {
+        hostSetInput(BUTTON_PIN, (i % 2) ? !finalLevel : finalLevel);
+        pollFor(input, intervalMs);
+    }
+    hostSetInput(BUTTON_PIN, finalLevel);
+}
+
+TEST(clean_press_is_accepted_after_the_debounce_time)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    pollFor(button, 100);
+    const unsigned long pressMs = millis();
+    hostSetInput(BUTTON_PIN, HIGH);
+    pollFor(button, DEBOUNCE_TIME_MS - 1);
+    CHECK(toggles.empty());
+    pollFor(button, 2);
+    CHECK_EQUAL((size_t)1, toggles.size());
+    CHECK_EQUAL(HIGH, toggles[0].state);
+    CHECK(toggles[0].timeMs - pressMs <= DEBOUNCE_TIME_MS + 1);
+    CHECK_EQUAL(HIGH, (int)button);
+}
+
+TEST(bounces_are_rejected)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    pollFor(button, 100);
+    // Contact bounce on pressing, then on releasing
+    bounce(button, 15, 2, HIGH);
+    pollFor(button, 100);
+    bounce(button, 15, 2, LOW);
+    pollFor(button, 100);
+    CHECK_EQUAL((size_t)2, toggles.size());
+    CHECK_EQUAL(HIGH, toggles[0].state);
+    CHECK_EQUAL(LOW, toggles[1].state);
+}
+
+TEST(glitch_shorter_than_the_debounce_time_is_ignored)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    pollFor(button, 100);
+    hostSetInput(BUTTON_PIN, HIGH);
+    pollFor(button, DEBOUNCE_TIME_MS / 2 - 1);
+    hostSetInput(BUTTON_PIN, LOW);
+    pollFor(button, 100);
+    CHECK(toggles.empty());
+}
+
+TEST(slow_polling_needs_two_agreeing_samples)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    pollFor(button, 200, 50);
+    // A glitch caught by a single poll, however long since the last
+    hostSetInput(BUTTON_PIN, HIGH);
+    button.poll();
+    hostSetInput(BUTTON_PIN, LOW);
+    pollFor(button, 200, 50);
+    CHECK(toggles.empty());
+    // Whereas a real press is seen by the second poll
+    hostSetInput(BUTTON_PIN, HIGH);
+    pollFor(button, 100, 50);
+    CHECK_EQUAL((size_t)1, toggles.size());
+}
+
+TEST(poll_never_blocks)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    CHECK(pollFor(button, 50));
+    hostSetInput(BUTTON_PIN, HIGH);
+    CHECK(pollFor(button, 50));
+    for (int i = 0; i < 20; ++i)
+    {
+        hostSetInput(BUTTON_PIN, i % 2);
+        CHECK(pollFor(button, 1));
+    }
+}
+
+/*******************************************************************************
+ * @brief   Checks that the toggles received alternate, starting with a press,
+ *          and finishing at the given state.
+ *
+ * @param   finalState  The state the last toggle should give
+ *
+ * @return  True if the toggles are consistent, false otherwise.
+ */
+static bool togglesAlternate(const int finalState)
+{
+    for (size_t i = 0; i < toggles.size(); ++i)
+    {
+        if (toggles[i].state != ((i % 2) ? LOW : HIGH))
+        {
+            return false;
+        }
+    }
+    return !toggles.empty() && (toggles.back().state == finalState);
+}
+
+/*******************************************************************************
+ * @brief   Makes an input interrupt driven, having cleared any inputs left
+ *          registered by an earlier test.
+ *
+ * @param   input   The input to register
+ *
+ * @return  True if the input is interrupt driven, false otherwise.
+ */
+static bool makeInterruptDriven(InputHelper &input)
+{
+    interruptInputCount = 0;
+    return input.enableInterrupt();
+}
+
+TEST(interrupt_press_is_seen_by_the_next_poll)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    CHECK(makeInterruptDriven(button));
+    pollFor(button, 100, 20);
+    // The press lands just after a poll, and is timed by the interrupt
+    hostAdvanceMs(1);
+    const unsigned long pressMs = millis();
+    hostSetInput(BUTTON_PIN, HIGH);
+    hostAdvanceMs(18);
+    CHECK(toggles.empty());
+    button.poll();
+    CHECK_EQUAL((size_t)1, toggles.size());
+    CHECK_EQUAL(HIGH, toggles[0].state);
+    CHECK_EQUAL(pressMs, toggles[0].timeMs - 18);
+}
+
+TEST(short_tap_between_polls_is_not_missed)
+{
+    toggles.clear();
+    InputHelper button(BUTTON_PIN, buttonToggled);
+    CHECK(makeInterruptDriven(button));
+    pollFor(button, 100, 20);
+    hostAdvanceMs(2);
+    hostSetInput(BUTTON_PIN, HIGH);
+    hostAdvanceMs(3);
+    hostSetInput(BUTTON_PIN, LOW);
+    pollFor(button, 100, 20);
+    CHECK_EQUAL((size_t)2, toggles.size());
+    CHECK(togglesAlternate(LOW));
+    CHECK_EQUAL(LOW, (int)button);
+}
+
+TEST(bounces_settle_to_the_final_level)
+{
+    for (int finalLevel = LOW; finalLevel <= HIGH; ++finalLevel)
+    {
+        toggles.clear();
+        InputHelper button(BUTTON_PIN, buttonToggled);
+        CHECK(makeInterruptDriven(button));
+        pollFor(button, 100);
+        // A press that bounces for 6ms, and either makes contact or, when the
+        // final edge falls within the ignored bounces, does not
+        for (int i = 0; i < 12; ++i)
+        {
+            hostSetInput(BUTTON_PIN, (i % 2) ? LOW : HIGH);
+            hostAdvanceUs(500);
+            button.poll();
+        }
+        hostSetInput(BUTTON_PIN, finalLevel);
+        pollFor(button, 100);
+        CHECK(togglesAlternate(finalLevel));
+        CHECK_EQUAL(finalLevel ? (size_t)1 : (size_t)2, toggles.size());
+        CHECK_EQUAL(finalLevel, (int)button);
+    }
+}
+
+TEST(queue_overflow_still_settles_correctly)
+{
+    for (int edges = INPUT_EVENT_QUEUE_SIZE - 1; edges <= 4 * INPUT_EVENT_QUEUE_SIZE; ++edges)
+    {
+        toggles.clear();
+        interruptInputCount = 0;
+        hostSetInput(BUTTON_PIN, LOW);
+        InputHelper button(BUTTON_PIN, buttonToggled);
+        CHECK(makeInterruptDriven(button));
+        pollFor(button, 100);
+        // More edges than the queue holds, all before the next poll
+        for (int i = 0; i < edges; ++i)
+        {
+            hostSetInput(BUTTON_PIN, (i % 2) ? LOW : HIGH);
+            hostAdvanceUs(200);
+        }
+        const int finalLevel = (edges % 2) ? HIGH : LOW;
+        pollFor(button, 100);
+        CHECK(togglesAlternate(finalLevel));
+        CHECK(toggles.size() <= 2);
+        CHECK_EQUAL(finalLevel, (int)button);
+    }
+}
+
+/// @brief  The time between polls of the buttons in the sketch's loop, in
+///         milliseconds, set by the time taken to draw a frame.
+static const unsigned long LOOP_PERIOD_MS = 20;
+
+/*******************************************************************************
+ * @brief   Presses the test button just after a poll, then polls it once per
+ *          loop until its toggle callback is made.
+ *
+ * @param   input   The input to press
+ *
+ * @return  The time from the press to the toggle callback, in milliseconds.
+ */
+static unsigned long pressLatencyMs(InputHelper &input)
+{
+    hostSetInput(BUTTON_PIN, LOW);
+    pollFor(input, 200, LOOP_PERIOD_MS);
+    input.poll();
+    toggles.clear();
+    hostAdvanceMs(1);
+    const unsigned long pressMs = millis();
+    hostSetInput(BUTTON_PIN, HIGH);
+    hostAdvanceMs(LOOP_PERIOD_MS - 1);
+    for (int loops = 0; toggles.empty() && loops < 100; ++loops)
+    {
+        input.poll();
+        hostAdvanceMs(LOOP_PERIOD_MS);
+    }
+    return toggles.empty() ? ~0UL : toggles[0].timeMs - pressMs;
+}
+
+TEST(interrupts_reduce_the_press_to_event_latency)
+{
+    interruptInputCount = 0;
+    InputHelper polled(BUTTON_PIN, buttonToggled);
+    const unsigned long polledMs = pressLatencyMs(polled);
+    InputHelper interrupted(BUTTON_PIN, buttonToggled);
+    CHECK(makeInterruptDriven(interrupted));
+    const unsigned long interruptMs = pressLatencyMs(interrupted);
+    printf("  press to toggle latency, polled every %lums: %lums de-bounced, "
+           "%lums interrupt driven\n", LOOP_PERIOD_MS, polledMs, interruptMs);
+    // Polled, the press needs two agreeing samples a loop apart. Interrupt
+    // driven, it is handled by the first poll after the press.
+    CHECK_EQUAL(2 * LOOP_PERIOD_MS - 1, polledMs);
+    CHECK_EQUAL(LOOP_PERIOD_MS - 1, interruptMs);
+}
@@ -0,0 +1,228 @@
+/**
+ * @file    test_kernels.cpp
+ *
+ * @brief   Compares the integer pattern kernels with the floating point
+ *          patterns they replaced, over every phase of a revolution. The float
+ *          patterns are reproduced here as they were, at full brightness.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "PatternKernels.h"
+#include <math.h>
+
+/// @brief  The number of LEDs, as in the sketch.
+static const byte LED_COUNT = 6;
+
+/// @brief  The number of phases in a revolution.
+static const long PHASE_COUNT = 65536;
+
+/// @brief  The start angles of the raindrops, in whole degrees.
+static const int RAINDROP_STARTS[LED_COUNT] = { 0, 57, 100, 180, 299, 347 };
+
+/// @brief  A float pattern, giving the brightness percentage of an LED from
+///         the angle of the lead point and of the LED, in degrees, and the
+///         extra value of the LED.
+typedef int (*FloatPattern)(float angle, float ledAngle, int extra);
+
+/**
+ * The float patterns, as they were before the integer kernels. The results
+ * were passed to globaliseBrightness(), which took an int, so are truncated.
+ */
+
+static int floatChaseAcw(const float angle, const float ledAngle, int)
+{
+    const int a = (int)((angle + 360.0f) + ledAngle) % 360;
+    return round((100.0f * (360 - a)) / 360.0f);
+}
+
+static int floatChaseCw(const float angle, const float ledAngle, int)
+{
+    const int a = (int)((angle + 360.0f) - ledAngle) % 360;
+    return round((100.0f * (360 - a)) / 360.0f);
+}
+
+static int floatChaseBoth(const float angle, const float ledAngle, int)
+{
+    const int a = min(
+        (int)((angle + 360.0f) - ledAngle) % 360,
+        (int)((angle + 360.0f) + ledAngle) % 360
+    );
+    return round((100.0f * (360 - a)) / 360.0f);
+}
+
+static int floatWaveCw(const float angle, const float ledAngle, int)
+{
+    int a = (int)(angle - ledAngle);
+    a = abs(((a + 180) % 360) - 180);
+    // LEDs more than 180 degrees past the peak came out negative, and were
+    // passed on to the duty cycle look up unchecked; the kernel leaves them
+    // off
+    const int value = round((100.0f * (180 - a)) / 180.0f);
+    return max(value, 0);
+}
+
+static int floatWaveAcw(const float angle, const float ledAngle, int)
+{
+    int a = (int)(angle - ledAngle);
+    a = abs((((360 - a) + 180) % 360) - 180);
+    return round((100.0f * (180 - a)) / 180.0f);
+}
+
+static int floatThrob(const float angle, float, int)
+{
+    const float RADS_PER_DEGREE = 0.0174533f;
+    return (1.0f + cos(angle * RADS_PER_DEGREE)) * 50.0f;
+}
+
+static int floatThrob2(const float angle, float, int)
+{
+    const float RADS_PER_DEGREE = 0.0174533f;
+    const int value = 2 * round(fabs(180.0f - angle));
+    return (1.0f + sin(value * RADS_PER_DEGREE)) * 50.0f;
+}
+
+static int floatHeartbeat(const float angle, float, int)
+{
+    const int delta = round(min(fabs(225.0f - angle), fabs(135.0f - angle)));
+    const int percent = round((100 * delta) / 135.0f);
+    const int value = round(((100 - percent) * 2.0f) - 100.0f);
+    // Negative values were passed on to the duty cycle look up unchecked;
+    // the kernel clamps them to off
+    return max(value, 0);
+}
+
+static int floatRaindrop(const float angle, float, const int extra)
+{
+    const int position = angle - extra;
+    if (position >= 0 && position < RaindropConstants::RAMPUP_ANGLE)
+    {
+        return round((100.0f * position) / RaindropConstants::RAMPUP_ANGLE);
+    }
+    else if ((position >= RaindropConstants::RAMPUP_ANGLE) &&
+            (position < RaindropConstants::RAINDROP_ANGLE))
+    {
+        return 100 - round((100.0f * (position - RaindropConstants::RAMPUP_ANGLE)) /
+            RaindropConstants::RAMPDOWN_ANGLE);
+    }
+    return 0;
+}
+
+/// @brief  A pattern drawn both ways.
+struct KernelPair
+{
+    const char *name;
+    PatternKernel kernel;
+    FloatPattern reference;
+};
+
+/// @brief  The patterns compared.
+static const KernelPair KERNEL_PAIRS[] =
+{
+    { "chase acw", chaseModeAcw, floatChaseAcw },
+    { "chase cw", chaseModeCw, floatChaseCw },
+    { "chase both", chaseModeBoth, floatChaseBoth },
+    { "wave cw", waveModeCw, floatWaveCw },
+    { "wave acw", waveModeAcw, floatWaveAcw },
+    { "throb", throbMode, floatThrob },
+    { "throb two", throbMode2, floatThrob2 },
+    { "heartbeat", heartbeatMode, floatHeartbeat },
+    { "raindrop", raindropMode, floatRaindrop },
+};
+
+/*******************************************************************************
+ * @brief   Gets the angle in degrees of a binary angle, as the float patterns
+ *          saw it.
+ *
+ * @param   phase   The binary angle
+ *
+ * @return  The angle in degrees.
+ */
+static float phaseToDegrees(const long phase)
+{
+    return (360.0f * (phase & 0xFFFF)) / PHASE_COUNT;
+}
+
+/*******************************************************************************
+ * @brief   Draws a pattern with its kernel and its float reference at every
+ *          phase, finding the largest difference for each LED. The float
+ *          pattern is given the same LED positions as the kernel. As the
+ *          float angle can round either way at a step in a pattern (such as
+ *          where a chase wraps from off to full), the kernel is compared with
+ *          the float pattern at the same phase and one phase step either side,
+ *          and the closest taken.
+ *
+ * @param   pair        The pattern to compare
+ * @param   maxErrors   The largest difference of each LED, as a percentage
+ */
+static void comparePattern(const KernelPair &pair, int * const maxErrors)
+{
+    uint16_t ledPhases[LED_COUNT];
+    int extras[LED_COUNT];
+    byte levels[LED_COUNT];
+    PatternContext context;
+    memset(&context, 0, sizeof(context));
+    context.count = LED_COUNT;
+    context.ledPhases = ledPhases;
+    context.extras = extras;
+    context.levels = levels;
+    for (byte i = 0; i < LED_COUNT; ++i)
+    {
+        ledPhases[i] = ((unsigned long)i << 16) / LED_COUNT;
+        extras[i] = RAINDROP_STARTS[i];
+        maxErrors[i] = 0;
+    }
+    for (long phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        context.phase = phase;
+        context.angle = ((unsigned long)phase * 360) >> 16;
+        pair.kernel(context);
+        for (byte i = 0; i < LED_COUNT; ++i)
+        {
+            const float ledAngle = phaseToDegrees(ledPhases[i]);
+            int error = 100;
+            for (long step = -1; step <= 1; ++step)
+            {
+                const float angle = phaseToDegrees(phase + step);
+                const int expected = pair.reference(angle, ledAngle, extras[i]);
+                error = min(error, abs(levels[i] - expected));
+            }
+            maxErrors[i] = max(maxErrors[i], error);
+        }
+    }
+}
+
+TEST(kernels_match_the_float_patterns)
+{
+    std::cout << "  max error per LED (%):" << std::endl;
+    for (const KernelPair &pair : KERNEL_PAIRS)
+    {
+        int maxErrors[LED_COUNT];
+        comparePattern(pair, maxErrors);
+        std::cout << "    " << pair.name << ":";
+        for (byte i = 0; i < LED_COUNT; ++i)
+        {
+            std::cout << " " << maxErrors[i];
+        }
+        std::cout << std::endl;
+        for (byte i = 0; i < LED_COUNT; ++i)
+        {
+            CHECK(maxErrors[i] <= 1);
+        }
+    }
+}
+
+TEST(just_on_is_full_brightness)
+{
+    byte levels[LED_COUNT] = { 0 };
+    PatternContext context;
+    memset(&context, 0, sizeof(context));
+    context.count = LED_COUNT;
+    context.levels = levels;
+    justOn(context);
+    for (byte i = 0; i < LED_COUNT; ++i)
+    {
+        CHECK_EQUAL(100, levels[i]);
+    }
+}
@@ -0,0 +1,99 @@
+/**
+ * @file    test_memory.cpp
+ *
+ * @brief   Tests the SRAM watermark scan against a painted buffer standing in
+ *          for the SRAM, with a heap and stack of known depths.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "MemoryMonitor.h"
+
+/// @brief  The size of the stand-in SRAM.
+static const int SRAM_SIZE = 256;
+
+/// @brief  The stand-in SRAM.
+static byte sram[SRAM_SIZE];
+
+/*******************************************************************************
+ * @brief   Paints the stand-in SRAM, then uses a depth of heap at its start
+ *          and of stack at its end.
+ *
+ * @param   heapDepth   The number of bytes of heap used
+ * @param   stackDepth  The number of bytes of stack used
+ */
+static void useMemory(const int heapDepth, const int stackDepth)
+{
+    paintMemory(sram, sram + SRAM_SIZE);
+    for (int i = 0; i < heapDepth; ++i)
+    {
+        sram[i] = (byte)i;
+    }
+    for (int i = 0; i < stackDepth; ++i)
+    {
+        sram[SRAM_SIZE - 1 - i] = (byte)~MEMORY_PAINT;
+    }
+}
+
+TEST(paint_covers_the_range_only)
+{
+    memset(sram, 0, sizeof(sram));
+    paintMemory(sram + 1, sram + SRAM_SIZE - 1);
+    CHECK_EQUAL(0, (int)sram[0]);
+    CHECK_EQUAL(0, (int)sram[SRAM_SIZE - 1]);
+    for (int i = 1; i < SRAM_SIZE - 1; ++i)
+    {
+        CHECK_EQUAL((int)MEMORY_PAINT, (int)sram[i]);
+    }
+}
+
+TEST(unused_memory_is_all_gap)
+{
+    MemoryWatermarks marks;
+    useMemory(0, 0);
+    scanMemoryWatermarks(sram, sram + SRAM_SIZE, &marks);
+    CHECK_EQUAL(0, marks.heapPeak);
+    CHECK_EQUAL(0, marks.stackPeak);
+    CHECK_EQUAL(SRAM_SIZE, marks.minGap);
+}
+
+TEST(scan_finds_the_known_depths)
+{
+    MemoryWatermarks marks;
+    for (int stackDepth = 1; stackDepth < SRAM_SIZE - 64; stackDepth += 7)
+    {
+        useMemory(40, stackDepth);
+        scanMemoryWatermarks(sram, sram + SRAM_SIZE, &marks);
+        CHECK_EQUAL(40, marks.heapPeak);
+        CHECK_EQUAL(stackDepth, marks.stackPeak);
+        CHECK_EQUAL(SRAM_SIZE - 40 - stackDepth, marks.minGap);
+    }
+}
+
+TEST(stray_paint_values_in_the_heap_are_passed_over)
+{
+    MemoryWatermarks marks;
+    useMemory(40, 30);
+    // Heap data that happens to match the paint, short of a full run
+    memset(sram + 10, MEMORY_PAINT, MEMORY_PAINT_RUN - 1);
+    scanMemoryWatermarks(sram, sram + SRAM_SIZE, &marks);
+    CHECK_EQUAL(40, marks.heapPeak);
+    CHECK_EQUAL(30, marks.stackPeak);
+}
+
+TEST(stack_frames_of_known_depth_are_found)
+{
+    MemoryWatermarks marks;
+    useMemory(0, 0);
+    // Nested calls, each pushing a frame, then returning
+    const int frameSize = 12;
+    for (int depth = 1; depth <= 5; ++depth)
+    {
+        memset(sram + SRAM_SIZE - (depth * frameSize), 0, frameSize);
+    }
+    // Returning leaves the stack's high water mark in place
+    scanMemoryWatermarks(sram, sram + SRAM_SIZE, &marks);
+    CHECK_EQUAL(5 * frameSize, marks.stackPeak);
+    CHECK_EQUAL(SRAM_SIZE - (5 * frameSize), marks.minGap);
+}
@@ -0,0 +1,371 @@
+/**
+ * @file    test_nonvol.cpp
+ *
+ * @brief   Tests the EEPROM backed NonVol classes.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "NonVol.h"
+#include <iomanip>
+
+/// @brief  A value to store, with a byte per field so the writes to each
+///         field can be told apart.
+struct TestValue
+{
+    uint8_t pattern;
+    uint8_t speed;
+    uint8_t brightness;
+    uint8_t density;
+};
+
+/// @brief  The EEPROM address the test values are stored at.
+static const int TEST_ADDRESS = 16;
+
+/// @brief  The commit delay used by the tests, in milliseconds.
+static const unsigned long TEST_COMMIT_DELAY_MS = 3000;
+
+/*******************************************************************************
+ * @brief   Polls a NonVol for a length of virtual time, as the sketch loop
+ *          does.
+ *
+ * @param   nv          The NonVol to poll
+ * @param   durationMs  The time to run for, in milliseconds
+ */
+template <class T>
+static void pollFor(NonVol<T> &nv, const unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ++ms)
+    {
+        nv.poll();
+        hostAdvanceMs(1);
+    }
+}
+
+TEST(burst_of_changes_is_committed_once)
+{
+    NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+    nv.load();
+    TestValue value = nv;
+    // A held button, changing the value every 100ms for two seconds
+    for (uint8_t i = 0; i < 20; ++i)
+    {
+        value.speed = i;
+        nv = value;
+        pollFor(nv, 100);
+    }
+    CHECK(nv.isDirty());
+    CHECK_EQUAL(0UL, EEPROM.writeCount);
+    pollFor(nv, TEST_COMMIT_DELAY_MS);
+    CHECK(!nv.isDirty());
+    CHECK_EQUAL(1UL, EEPROM.cellWrites[TEST_ADDRESS + offsetof(TestValue, speed)]);
+    CHECK_EQUAL(19, EEPROM.cells[TEST_ADDRESS + offsetof(TestValue, speed)]);
+    CHECK_EQUAL(1UL, nv.getWriteCount());
+}
+
+TEST(commit_waits_for_the_value_to_settle)
+{
+    NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+    nv.load();
+    TestValue value = nv;
+    value.pattern = 1;
+    nv = value;
+    pollFor(nv, TEST_COMMIT_DELAY_MS - 1);
+    value.pattern = 2;
+    nv = value;
+    // The delay restarts from the latest change
+    pollFor(nv, TEST_COMMIT_DELAY_MS - 1);
+    CHECK_EQUAL(0UL, EEPROM.writeCount);
+    pollFor(nv, 2);
+    CHECK_EQUAL(1UL, EEPROM.writeCount);
+    CHECK_EQUAL(2, EEPROM.cells[TEST_ADDRESS + offsetof(TestValue, pattern)]);
+}
+
+TEST(unchanged_bytes_are_not_rewritten)
+{
+    NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+    nv.load();
+    const TestValue first = { 1, 2, 3, 4 };
+    nv = first;
+    nv.flush();
+    CHECK_EQUAL((unsigned long)sizeof(TestValue), EEPROM.writeCount);
+    TestValue second = first;
+    second.brightness = 30;
+    nv = second;
+    nv.flush();
+    CHECK_EQUAL((unsigned long)sizeof(TestValue) + 1, EEPROM.writeCount);
+    CHECK_EQUAL(1UL, EEPROM.cellWrites[TEST_ADDRESS + offsetof(TestValue, pattern)]);
+    CHECK_EQUAL(2UL, EEPROM.cellWrites[TEST_ADDRESS + offsetof(TestValue, brightness)]);
+    CHECK_EQUAL((unsigned long)sizeof(TestValue) - 1, nv.getAvoidedWriteCount());
+}
+
+TEST(setting_the_same_value_is_not_a_change)
+{
+    NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+    nv.load();
+    const TestValue value = nv;
+    nv = value;
+    CHECK(!nv.isDirty());
+    pollFor(nv, TEST_COMMIT_DELAY_MS * 2);
+    CHECK_EQUAL(0UL, EEPROM.writeCount);
+}
+
+TEST(reverted_change_writes_nothing)
+{
+    NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+    nv.load();
+    const TestValue original = nv;
+    TestValue value = original;
+    value.density = 50;
+    nv = value;
+    nv = original;
+    pollFor(nv, TEST_COMMIT_DELAY_MS * 2);
+    CHECK_EQUAL(0UL, EEPROM.writeCount);
+}
+
+TEST(value_is_reloaded_after_a_power_cycle)
+{
+    {
+        NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+        nv.load();
+        const TestValue value = { 5, 6, 7, 8 };
+        nv = value;
+        pollFor(nv, TEST_COMMIT_DELAY_MS + 1);
+    }
+    NonVol<TestValue> nv(TEST_ADDRESS, TEST_COMMIT_DELAY_MS);
+    nv.load();
+    CHECK_EQUAL(5, nv->pattern);
+    CHECK_EQUAL(8, nv->density);
+}
+
+/// @brief  A wear-levelled test value.
+typedef WearLevelledNonVol<TestValue> LevelledValue;
+
+/// @brief  The size of each record of the wear-levelled test value.
+static const int RECORD_SIZE = LevelledValue::regionLength(1);
+
+/// @brief  The bytes of each record in use: the sequence number, the value and
+///         the CRC. The rest is padding, to the alignment of the sequence.
+static const int RECORD_USED = sizeof(uint16_t) + sizeof(TestValue) + 1;
+
+/// @brief  The number of slots the wear-levelled tests use.
+static const int TEST_SLOTS = 5;
+
+/*******************************************************************************
+ * @brief   Makes a test value from a number, spread over all of its fields.
+ *
+ * @param   number  The number
+ *
+ * @return  The test value.
+ */
+static TestValue makeValue(const uint32_t number)
+{
+    const TestValue value =
+    {
+        (uint8_t)number,
+        (uint8_t)(number >> 8),
+        (uint8_t)(number >> 16),
+        (uint8_t)(number >> 24)
+    };
+    return value;
+}
+
+/*******************************************************************************
+ * @brief   Commits a value straight away.
+ *
+ * @param   nv      The wear-levelled value to commit to
+ * @param   number  The number to make the value from
+ */
+static void commitValue(LevelledValue &nv, const uint32_t number)
+{
+    nv = makeValue(number);
+    nv.flush();
+}
+
+/*******************************************************************************
+ * @brief   Checks whether the value reloaded from EEPROM, as after a power
+ *          cycle, is the one made from the given number.
+ *
+ * @param   number  The number the value was made from
+ * @param   slots   The number of slots of the region
+ *
+ * @return  True if the reloaded value matches, false otherwise.
+ */
+static bool reloadsAs(const uint32_t number, const int slots = TEST_SLOTS)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(slots));
+    nv.load();
+    const TestValue expected = makeValue(number);
+    return memcmp(&nv(), &expected, sizeof(TestValue)) == 0;
+}
+
+TEST(region_is_divided_into_whole_slots)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS) + RECORD_SIZE - 1);
+    nv.load();
+    CHECK_EQUAL(TEST_SLOTS, nv.getSlotCount());
+    CHECK_EQUAL(TEST_SLOTS, LevelledValue::slotCount(LevelledValue::regionLength(TEST_SLOTS)));
+}
+
+TEST(region_too_small_for_a_record_stores_nothing)
+{
+    LevelledValue nv(TEST_ADDRESS, RECORD_SIZE - 1);
+    nv.load();
+    CHECK_EQUAL(0, nv.getSlotCount());
+    commitValue(nv, 1234);
+    CHECK_EQUAL(0UL, EEPROM.writeCount);
+    CHECK(!nv.isDirty());
+}
+
+TEST(erased_region_reads_as_erased)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+    nv.load();
+    CHECK_EQUAL(0xFF, nv->pattern);
+    CHECK_EQUAL(0xFF, nv->density);
+}
+
+TEST(commits_rotate_through_the_slots)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+    nv.load();
+    for (uint32_t i = 0; i < TEST_SLOTS * 2; ++i)
+    {
+        commitValue(nv, i + 1);
+    }
+    // The sequence number changes on every commit, so each slot has had its
+    // first byte written once per lap of the ring
+    for (int slot = 0; slot < TEST_SLOTS; ++slot)
+    {
+        CHECK_EQUAL(2UL, EEPROM.cellWrites[TEST_ADDRESS + slot * RECORD_SIZE]);
+    }
+    CHECK_EQUAL(0UL, EEPROM.cellWrites[TEST_ADDRESS + TEST_SLOTS * RECORD_SIZE]);
+}
+
+TEST(newest_record_is_reloaded_at_every_position)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+    nv.load();
+    for (uint32_t i = 1; i <= TEST_SLOTS * 3; ++i)
+    {
+        commitValue(nv, i * 1000);
+        CHECK(reloadsAs(i * 1000));
+    }
+}
+
+TEST(torn_write_falls_back_to_the_previous_record)
+{
+    // Power is lost after each possible number of bytes of the newest record
+    // have been written
+    for (int written = 0; written < RECORD_USED; ++written)
+    {
+        EEPROM.clear();
+        LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+        nv.load();
+        for (uint32_t i = 1; i <= TEST_SLOTS + 2; ++i)
+        {
+            commitValue(nv, i);
+        }
+        uint8_t before[EEPROMClass::SIZE];
+        memcpy(before, EEPROM.cells, sizeof(before));
+        commitValue(nv, 0xA5A5A5A5);
+        const int newest = TEST_ADDRESS + (TEST_SLOTS + 2) % TEST_SLOTS * RECORD_SIZE;
+        memcpy(&EEPROM.cells[newest + written],
+               &before[newest + written],
+               RECORD_SIZE - written);
+        CHECK(reloadsAs(TEST_SLOTS + 2));
+    }
+}
+
+TEST(corrupt_record_is_rejected_by_its_crc)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+    nv.load();
+    for (uint32_t i = 1; i <= 3; ++i)
+    {
+        commitValue(nv, i);
+    }
+    const int newest = TEST_ADDRESS + 2 * RECORD_SIZE;
+    // Flip each bit of the newest record in turn
+    for (int bit = 0; bit < RECORD_USED * 8; ++bit)
+    {
+        EEPROM.cells[newest + bit / 8] ^= _BV(bit % 8);
+        CHECK(reloadsAs(2));
+        EEPROM.cells[newest + bit / 8] ^= _BV(bit % 8);
+    }
+    CHECK(reloadsAs(3));
+}
+
+TEST(sequence_number_wraps_around)
+{
+    LevelledValue nv(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+    nv.load();
+    // The erased sequence number is skipped, so the numbers wrap after
+    // 0xFFFF commits. Check each commit either side of the wrap.
+    for (uint32_t i = 1; i <= 0x10010; ++i)
+    {
+        commitValue(nv, i);
+        if (i >= 0xFFF0)
+        {
+            CHECK(reloadsAs(i));
+        }
+    }
+    // And that commits carry on from a reloaded position after the wrap
+    LevelledValue reloaded(TEST_ADDRESS, LevelledValue::regionLength(TEST_SLOTS));
+    reloaded.load();
+    for (uint32_t i = 1; i <= TEST_SLOTS * 2; ++i)
+    {
+        commitValue(reloaded, i);
+        CHECK(reloadsAs(i));
+    }
+}
+
+TEST(wear_simulation)
+{
+    // A value the size of the settings on the Nano, committed a million times
+    // to a 1KB EEPROM, once stored at a fixed address and once wear-levelled
+    // over the settings region
+    struct SettingsSized
+    {
+        uint8_t bytes[9];
+    };
+    static const unsigned long COMMITS = 1000000;
+    static const unsigned long CELL_ENDURANCE = 100000;
+    static const int SLOTS = 21;
+
+    SettingsSized value;
+    memset(&value, 0, sizeof(value));
+    {
+        NonVol<SettingsSized> fixed(0);
+        fixed.load();
+        for (unsigned long i = 0; i < COMMITS; ++i)
+        {
+            ++value.bytes[0];
+            fixed = value;
+        }
+    }
+    const unsigned long fixedWear = EEPROM.maxCellWrites();
+
+    EEPROM.clear();
+    WearLevelledNonVol<SettingsSized> levelled(
+        0, WearLevelledNonVol<SettingsSized>::regionLength(SLOTS));
+    levelled.load();
+    for (unsigned long i = 0; i < COMMITS; ++i)
+    {
+        ++value.bytes[0];
+        levelled = value;
+    }
+    const unsigned long levelledWear = EEPROM.maxCellWrites();
+
+    std::cout << "  " << COMMITS << " commits: most worn cell written "
+              << fixedWear << " times at a fixed address, "
+              << levelledWear << " times wear-levelled over " << SLOTS
+              << " slots (" << std::fixed << std::setprecision(1)
+              << (double)fixedWear / levelledWear << "x less), so "
+              << CELL_ENDURANCE * fixedWear / levelledWear
+              << " commits before a cell reaches its endurance" << std::endl;
+    CHECK_EQUAL(COMMITS, fixedWear);
+    CHECK_EQUAL((COMMITS + SLOTS - 1) / SLOTS, levelledWear);
+    CHECK_EQUAL(12, WearLevelledNonVol<SettingsSized>::regionLength(1));
+}
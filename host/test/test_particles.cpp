@@ -0,0 +1,180 @@
+/**
+ * @file    test_particles.cpp
+ *
+ * @brief   Tests the particle engine behind the particle patterns: the spawn
+ *          rate set by the density, expiry, and a full particle pool.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "PatternKernels.h"
+
+/// @brief  The number of LEDs drawn.
+static const byte LED_COUNT = 6;
+
+/**
+ * A pattern context drawing into its own LEDs and particle pool.
+ */
+struct ParticleRig
+{
+    uint16_t ledPhases[LED_COUNT];
+    byte levels[LED_COUNT];
+    ParticlePool pool;
+    FastRandom rng;
+    PatternContext context;
+
+    /***************************************************************************
+     * @brief   Constructor - Sets up the context with an empty particle pool.
+     *
+     * @param   density     The particle density as a percentage
+     */
+    explicit ParticleRig(const byte density)
+    : pool()
+    , rng()
+    , context()
+    {
+        for (byte i = 0; i < LED_COUNT; ++i)
+        {
+            ledPhases[i] = ((unsigned long)i << 16) / LED_COUNT;
+        }
+        context.count = LED_COUNT;
+        context.ledPhases = ledPhases;
+        context.levels = levels;
+        context.density = density;
+        context.particles = &pool;
+        context.rng = &rng;
+        resetParticles(context);
+    }
+
+    /***************************************************************************
+     * @brief   Moves the lead point on and steps the particles.
+     *
+     * @param   delta   The distance to move the lead point, as a binary angle
+     * @param   kind    The ParticleKind to spawn
+     * @param   spawns  The particles spawned per revolution at full density
+     *
+     * @return  The number of particles spawned.
+     */
+    int step(const uint16_t delta, const byte kind, const byte spawns)
+    {
+        context.phase += delta;
+        stepParticles(context, kind, spawns);
+        int spawned = 0;
+        for (byte p = 0; p < pool.active; ++p)
+        {
+            spawned += (pool.particles[p].age == 0) ? 1 : 0;
+        }
+        return spawned;
+    }
+};
+
+TEST(density_zero_spawns_nothing)
+{
+    ParticleRig rig(0);
+    for (int frame = 0; frame < 1000; ++frame)
+    {
+        CHECK_EQUAL(0, rig.step(0x200, PARTICLE_SPARK, MAX_SPARK_SPAWNS));
+        drawParticles(rig.context);
+        for (const byte level : rig.levels)
+        {
+            CHECK_EQUAL(0, (int)level);
+        }
+    }
+}
+
+TEST(density_sets_the_spawns_per_revolution)
+{
+    const byte densities[] = { 1, 25, 50, 100 };
+    for (const byte density : densities)
+    {
+        ParticleRig rig(density);
+        int spawned = 0;
+        // Ten revolutions, 64 frames each
+        for (int frame = 0; frame < 640; ++frame)
+        {
+            spawned += rig.step(0x400, PARTICLE_DROP, MAX_DROP_SPAWNS);
+            CHECK(rig.pool.active < PARTICLE_POOL_SIZE);
+        }
+        CHECK_EQUAL(10 * ((MAX_DROP_SPAWNS * density + 50) / 100), spawned);
+    }
+}
+
+TEST(particles_expire_at_the_end_of_their_life)
+{
+    const byte kinds[] = { PARTICLE_DROP, PARTICLE_COMET_CW, PARTICLE_SPARK };
+    for (const byte kind : kinds)
+    {
+        ParticleRig rig(0);
+        rig.pool.active = 1;
+        rig.pool.particles[0].position = 0x1234;
+        rig.pool.particles[0].age = 0;
+        rig.pool.particles[0].kind = kind;
+        const uint16_t life = particleLife(kind);
+        rig.step(life - 1, kind, 0);
+        CHECK_EQUAL(1, (int)rig.pool.active);
+        CHECK_EQUAL(life - 1, (int)rig.pool.particles[0].age);
+        rig.step(1, kind, 0);
+        CHECK_EQUAL(0, (int)rig.pool.active);
+    }
+}
+
+TEST(expired_particle_is_replaced_by_the_last_active)
+{
+    ParticleRig rig(0);
+    rig.pool.active = 3;
+    const uint16_t ages[] = { 0x100, DROP_LIFE - 0x10, 0x200 };
+    for (byte p = 0; p < 3; ++p)
+    {
+        rig.pool.particles[p].position = p;
+        rig.pool.particles[p].age = ages[p];
+        rig.pool.particles[p].kind = PARTICLE_DROP;
+    }
+    rig.step(0x20, PARTICLE_DROP, 0);
+    CHECK_EQUAL(2, (int)rig.pool.active);
+    CHECK_EQUAL(0, (int)rig.pool.particles[0].position);
+    CHECK_EQUAL(0x120, (int)rig.pool.particles[0].age);
+    CHECK_EQUAL(2, (int)rig.pool.particles[1].position);
+    CHECK_EQUAL(0x220, (int)rig.pool.particles[1].age);
+}
+
+TEST(full_pool_drops_spawns_rather_than_bursting_later)
+{
+    ParticleRig rig(100);
+    // Long lived comets fill the pool, with more due than it holds
+    rig.step(0x8000, PARTICLE_COMET_CW, MAX_SPARK_SPAWNS);
+    CHECK_EQUAL((int)PARTICLE_POOL_SIZE, (int)rig.pool.active);
+    CHECK(rig.pool.spawnCredit < 0x10000);
+    for (int frame = 0; frame < 100; ++frame)
+    {
+        rig.step(0x40, PARTICLE_COMET_CW, MAX_SPARK_SPAWNS);
+        CHECK(rig.pool.active <= PARTICLE_POOL_SIZE);
+    }
+    // Once they have all expired, the pool refills at the usual rate only
+    rig.pool.active = 0;
+    CHECK(rig.step(0x800, PARTICLE_COMET_CW, MAX_SPARK_SPAWNS) <= ((0x800 * MAX_SPARK_SPAWNS) >> 16) + 1);
+}
+
+TEST(full_pool_levels_stay_in_range)
+{
+    const byte kinds[] = { PARTICLE_DROP, PARTICLE_COMET_CW, PARTICLE_SPARK };
+    for (const byte kind : kinds)
+    {
+        ParticleRig rig(100);
+        primeParticles(rig.context);
+        for (int frame = 0; frame < 500; ++frame)
+        {
+            if (frame % 50 == 0)
+            {
+                primeParticles(rig.context);
+            }
+            rig.step(0x80, kind, MAX_SPARK_SPAWNS);
+            CHECK(rig.pool.active <= PARTICLE_POOL_SIZE);
+            drawParticles(rig.context);
+            for (const byte level : rig.levels)
+            {
+                CHECK(level <= 100);
+            }
+        }
+    }
+}
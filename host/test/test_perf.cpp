@@ -0,0 +1,60 @@
+/**
+ * @file    test_perf.cpp
+ *
+ * @brief   Tests the performance counters, built in to the whole sketch, over
+ *          runs long enough to overflow their 32-bit arithmetic on the AVR.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#define PERF_STATS
+#include "HostTest.h"
+#include "sketch_nuka_cola.ino"
+
+TEST(loop_rate_does_not_overflow)
+{
+    // 4.29 million loops is under an hour at 1.2k loops per second
+    CHECK_EQUAL((uint32_t)1200, perfPerSecond(4320000UL, 3600000UL));
+    CHECK_EQUAL((uint32_t)5000000, perfPerSecond(5000000UL, 1000UL));
+    CHECK_EQUAL((uint32_t)0, perfPerSecond(0UL, 1UL));
+    CHECK_EQUAL((uint32_t)UINT32_MAX / 1000, perfPerSecond(UINT32_MAX, 1000000UL));
+}
+
+TEST(counters_saturate_rather_than_wrap)
+{
+    unsigned long counter = ULONG_MAX - 2;
+    perfAdd(counter, 1);
+    CHECK_EQUAL(ULONG_MAX - 1, counter);
+    perfAdd(counter, 5);
+    CHECK_EQUAL(ULONG_MAX, counter);
+    perfAdd(counter, 1);
+    CHECK_EQUAL(ULONG_MAX, counter);
+}
+
+TEST(frame_histogram_counts_past_16_bits)
+{
+    perfReset();
+    for (unsigned long frame = 0; frame < 70000; ++frame)
+    {
+        perfFrameInterval(20400);
+    }
+    CHECK_EQUAL(70000UL, perfCounters.frameBins[2]);
+}
+
+TEST(stats_reply_gives_the_loop_rate)
+{
+    setup();
+    // A loop every 500us is 2000 loops per second
+    const unsigned long long endUs = hostTimeUs() + 5000000ULL;
+    while (hostTimeUs() < endUs)
+    {
+        loop();
+        hostAdvanceUs(500);
+    }
+    hostSerialTake();
+    hostSerialSend("stats?\n");
+    loop();
+    const std::string reply = hostSerialTake();
+    CHECK(reply.find("stats lps=2000 ") == 0);
+    CHECK(reply.find(" hist=") != std::string::npos);
+}
@@ -0,0 +1,133 @@
+/**
+ * @file    test_seed.cpp
+ *
+ * @brief   Tests that seeding the random patterns restarts them cleanly, so
+ *          that the same seed always gives the same frames.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "TestCluster.h"
+#include <vector>
+
+/// @brief  A whole number of milliseconds that is also a whole number of
+///         frames, so runs this far apart see the frame tick at the same time.
+static const unsigned long FRAME_ALIGNED_MS = 102;
+
+/// @brief  The time for a frame to reach the outputs: the frame it is drawn
+///         in, then the tick it is committed on.
+static const unsigned long FRAME_LATENCY_MS = 45;
+
+/// @brief  The time to record for, which with the latency before it keeps the
+///         runs frame aligned.
+static const unsigned long RECORD_MS = (FRAME_ALIGNED_MS * 30) - FRAME_LATENCY_MS;
+
+/*******************************************************************************
+ * @brief   Records the duty cycles written to the LEDs every millisecond,
+ *          from the first frame drawn.
+ *
+ * @param   cluster     The cluster
+ *
+ * @return  The duty cycles, LED by LED, for each millisecond.
+ */
+static std::vector<int> recordDuties(TestCluster &cluster)
+{
+    std::vector<int> duties;
+    runCluster(cluster, FRAME_LATENCY_MS);
+    for (unsigned long ms = 0; ms < RECORD_MS; ++ms)
+    {
+        runCluster(cluster, 1);
+        for (const uint8_t pin : TEST_CLUSTER_PINS)
+        {
+            duties.push_back(hostPwm(pin));
+        }
+    }
+    return duties;
+}
+
+/*******************************************************************************
+ * @brief   Gets the number of LEDs that are lit.
+ *
+ * @return  The number of LEDs with a duty cycle above zero.
+ */
+static int litLeds()
+{
+    int lit = 0;
+    for (const uint8_t pin : TEST_CLUSTER_PINS)
+    {
+        lit += (hostPwm(pin) > 0) ? 1 : 0;
+    }
+    return lit;
+}
+
+TEST(seed_does_not_burst_particles)
+{
+    TestCluster cluster;
+    cluster.setBrightnessPercent(100);
+    cluster.setTransitionTime(0);
+    cluster.setPattern(Patterns::Sparks);
+    cluster.setDensity(100);
+    // Let the lead point get well away from the start of the revolution
+    for (int attempt = 0; attempt < 20; ++attempt)
+    {
+        runCluster(cluster, 1000 + (attempt * 37));
+        cluster.setRandomSeed(1234);
+        // Even at full density, only a spark or two in the first frames
+        runCluster(cluster, 50);
+        CHECK(litLeds() <= 4);
+    }
+}
+
+TEST(wake_does_not_burst_particles)
+{
+    TestCluster cluster;
+    cluster.setBrightnessPercent(100);
+    cluster.setTransitionTime(0);
+    cluster.setPattern(Patterns::Sparks);
+    cluster.setDensity(100);
+    for (int attempt = 0; attempt < 20; ++attempt)
+    {
+        runCluster(cluster, 1000 + (attempt * 37));
+        cluster.shutdown();
+        runCluster(cluster, 100);
+        cluster.startUp();
+        runCluster(cluster, 50);
+        CHECK(litLeds() <= 4);
+    }
+}
+
+TEST(same_seed_gives_the_same_frames)
+{
+    const Patterns patterns[] =
+    {
+        Patterns::Raindrop, Patterns::Flames, Patterns::Static,
+        Patterns::Drops, Patterns::Comets, Patterns::Sparks
+    };
+    for (const Patterns pattern : patterns)
+    {
+        TestCluster cluster;
+        cluster.setBrightnessPercent(100);
+        cluster.setTransitionTime(0);
+        cluster.setPattern(pattern);
+        cluster.setSpeedPercent(50);
+        const LayerSettings layer = { Patterns::Sparks, BLEND_SCREEN, 50, DEFAULT_SPEED };
+        CHECK(cluster.setLayer(0, layer));
+        runCluster(cluster, FRAME_ALIGNED_MS * 3);
+        cluster.setRandomSeed(1234);
+        const std::vector<int> first = recordDuties(cluster);
+        // A different history, with the lead points elsewhere, then the same
+        // seed again
+        cluster.setSpeedPercent(10);
+        runCluster(cluster, FRAME_ALIGNED_MS * 7);
+        cluster.setSpeedPercent(100);
+        runCluster(cluster, FRAME_ALIGNED_MS * 2);
+        cluster.setSpeedPercent(50);
+        cluster.setRandomSeed(1234);
+        const std::vector<int> second = recordDuties(cluster);
+        CHECK(first == second);
+        // Whereas another seed gives other frames
+        runCluster(cluster, FRAME_ALIGNED_MS * 5);
+        cluster.setRandomSeed(4321);
+        CHECK(first != recordDuties(cluster));
+    }
+}
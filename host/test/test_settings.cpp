@@ -0,0 +1,73 @@
+/**
+ * @file    test_settings.cpp
+ *
+ * @brief   Tests how the LED cluster uses the settings held in EEPROM.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "TestCluster.h"
+
+TEST(frames_do_not_read_eeprom)
+{
+    TestCluster cluster;
+    runCluster(cluster, 1000);
+    const unsigned long reads = EEPROM.readCount;
+    cluster.resetFrameStats();
+    runCluster(cluster, 2000);
+    CHECK(framesDrawn(cluster) >= 90);
+    CHECK_EQUAL(reads, EEPROM.readCount);
+}
+
+TEST(settings_changes_do_not_read_eeprom_until_committed)
+{
+    TestCluster cluster;
+    runCluster(cluster, 1000);
+    const unsigned long reads = EEPROM.readCount;
+    cluster.setPattern(Patterns::Throb);
+    cluster.setSpeedPercent(50);
+    runCluster(cluster, 1000);
+    CHECK_EQUAL(reads, EEPROM.readCount);
+    // Once committed, the steady state is back to no reads at all
+    runCluster(cluster, 5000);
+    const unsigned long committedReads = EEPROM.readCount;
+    CHECK(committedReads > reads);
+    runCluster(cluster, 2000);
+    CHECK_EQUAL(committedReads, EEPROM.readCount);
+}
+
+TEST(construction_leaves_the_hardware_alone)
+{
+    // A global cluster is constructed before the Arduino core is set up, so
+    // the hardware is only touched once begin() is called from setup()
+    hostTimsk2 = 0;
+    TestCluster::LedCluster cluster;
+    CHECK_EQUAL(0UL, EEPROM.readCount);
+    CHECK_EQUAL(0, hostTimsk2 & _BV(TOIE2));
+    cluster.begin();
+    CHECK(EEPROM.readCount > 0);
+    CHECK(hostTimsk2 & _BV(TOIE2));
+    CHECK_EQUAL(OUTPUT, hostPinMode(TEST_CLUSTER_PINS[0]));
+}
+
+TEST(stored_layer_too_fast_restores_the_defaults)
+{
+    {
+        TestCluster cluster;
+        cluster.setPattern(Patterns::Throb);
+        cluster.shutdown();
+    }
+    // Store a layer faster than the fastest speed, as a corrupt record or an
+    // older build might have
+    WearLevelledNonVol<Settings> settingsNV(SETTINGS_EEPROM_START, SETTINGS_EEPROM_LENGTH);
+    settingsNV.load();
+    Settings settings = settingsNV;
+    CHECK_EQUAL((int)Patterns::Throb, (int)settings.pattern);
+    settings.layers[0].revsPerMinute = SpeedConstants::MAX_SPEED + 1;
+    settingsNV = settings;
+    settingsNV.flush();
+    TestCluster cluster;
+    LayerSettings layer;
+    cluster.getLayer(0, &layer);
+    CHECK_EQUAL((int)SpeedConstants::DEFAULT_SPEED, (int)layer.revsPerMinute);
+}
@@ -0,0 +1,168 @@
+/**
+ * @file    test_sketch.cpp
+ *
+ * @brief   Tests the whole sketch running on the mock core: that it starts,
+ *          drives its LEDs from the frame tick and answers serial requests.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#include "HostTest.h"
+#include "sketch_nuka_cola.ino"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+/// @brief  The pins driving the display LEDs.
+static const uint8_t DISPLAY_PINS[] =
+{
+    DisplayLED1, DisplayLED2, DisplayLED3, DisplayLED4, DisplayLED5, DisplayLED6
+};
+
+/*******************************************************************************
+ * @brief   Runs the sketch loop for a length of virtual time.
+ *
+ * @param   durationMs  The time to run for, in milliseconds
+ * @param   stepUs      The time between each call to loop(), in microseconds
+ */
+static void runLoop(const unsigned long durationMs, const unsigned long stepUs = 100)
+{
+    const unsigned long long endUs = hostTimeUs() + durationMs * 1000ULL;
+    while (hostTimeUs() < endUs)
+    {
+        loop();
+        hostAdvanceUs(stepUs);
+    }
+}
+
+TEST(setup_starts_the_frame_tick)
+{
+    setup();
+    CHECK(hostTimsk2 & _BV(TOIE2));
+    CHECK(hostPcicr != 0);
+    for (const uint8_t pin : DISPLAY_PINS)
+    {
+        CHECK_EQUAL(OUTPUT, hostPinMode(pin));
+    }
+}
+
+TEST(loop_drives_the_display_leds)
+{
+    setup();
+    runLoop(2000);
+    for (const uint8_t pin : DISPLAY_PINS)
+    {
+        CHECK(hostPwmWrites(pin) > 0);
+    }
+}
+
+TEST(api_request_is_answered)
+{
+    setup();
+    hostSerialTake();
+    hostSerialSend("api?\n");
+    runLoop(10);
+    const std::string reply = hostSerialTake();
+    CHECK(reply.find("Speed [S] 10-100") != std::string::npos);
+}
+
+TEST(command_sent_in_pieces_is_handled_once_complete)
+{
+    setup();
+    hostSerialTake();
+    hostSerialSend("P");
+    runLoop(10);
+    CHECK_EQUAL(std::string(), hostSerialTake());
+    hostSerialSend("=");
+    runLoop(10);
+    hostSerialSend("3\n");
+    runLoop(10);
+    CHECK_EQUAL(std::string("P=3\r\n"), hostSerialTake());
+}
+
+TEST(any_line_ending_ends_a_command)
+{
+    setup();
+    hostSerialTake();
+    hostSerialSend("S=50\r\nB=60\rT=0\n");
+    runLoop(10);
+    CHECK_EQUAL(std::string("S=50\r\nB=60\r\nT=0\r\n"), hostSerialTake());
+}
+
+TEST(line_too_long_is_dropped)
+{
+    setup();
+    hostSerialTake();
+    hostSerialSend("P=3 and a lot more than fits\nS=20\n");
+    runLoop(10);
+    CHECK_EQUAL(std::string("S=20\r\n"), hostSerialTake());
+}
+
+TEST(bench_reply_is_a_csv_table)
+{
+    setup();
+    hostSerialTake();
+    hostSerialSend("bench?\n");
+    runLoop(10);
+    std::istringstream reply(hostSerialTake());
+    std::string line;
+    std::getline(reply, line);
+    CHECK_EQUAL(std::string("pattern,cycles_per_frame,cycles_per_led,max_leds_50fps\r"), line);
+    int rows = 0;
+    while (std::getline(reply, line))
+    {
+        // An index and three counts, the counts being zero on the virtual clock
+        unsigned long index = 0, frame = 0, led = 0, maxLeds = 0;
+        char end = 0;
+        CHECK_EQUAL(5, sscanf(line.c_str(), "%lu,%lu,%lu,%lu%c", &index, &frame, &led, &maxLeds, &end));
+        CHECK_EQUAL('\r', end);
+        CHECK_EQUAL((unsigned long)rows, index);
+        ++rows;
+    }
+    CHECK_EQUAL((int)Patterns::PATTERN_COUNT, rows);
+}
+
+/*******************************************************************************
+ * @brief   Sets the random seed over serial, then records the display LEDs
+ *          once every millisecond.
+ *
+ * @param   commands    Any commands to send after setting the seed
+ * @param   reply       Set to the reply to the commands
+ *
+ * @return  The duty cycle of each LED, LED by LED, for each millisecond.
+ */
+static std::vector<int> recordSeeded(const char * const commands, std::string &reply)
+{
+    // 102ms is a whole number of frames, so each recording sees the same frames
+    static const unsigned long FRAME_ALIGNED_MS = 102;
+    hostSerialSend("seed=1234\n");
+    runLoop(FRAME_ALIGNED_MS);
+    hostSerialTake();
+    hostSerialSend(commands);
+    std::vector<int> duties;
+    for (unsigned long ms = 0; ms < FRAME_ALIGNED_MS * 5; ++ms)
+    {
+        runLoop(1);
+        for (const uint8_t pin : DISPLAY_PINS)
+        {
+            duties.push_back(hostPwm(pin));
+        }
+    }
+    reply = hostSerialTake();
+    return duties;
+}
+
+TEST(seed_request_leaves_the_seed_alone)
+{
+    setup();
+    cluster.setTransitionTime(0);
+    cluster.setPattern(Patterns::Sparks);
+    std::string reply;
+    const std::vector<int> seeded = recordSeeded("", reply);
+    const std::vector<int> requested = recordSeeded(
+        "seed?\nseedx\nseed=\nseed=70000\nseed=12a\n", reply);
+    CHECK_EQUAL(std::string(
+        "seed=1234\r\nseed=1234\r\nInvalid seed\r\nInvalid seed\r\nInvalid seed\r\n"), reply);
+    CHECK(seeded == requested);
+}
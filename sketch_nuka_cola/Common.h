@@ -7,9 +7,10 @@
  * @date    2020
  */
 #pragma once
+#include <Arduino.h>
 
-/// @brief  The list of pins available
-/// @TODO   Map these to different Arduino boards at some point
+/// @brief  The list of pins available, on the Arduino Nano. The PWM timer
+///         each pin is driven by is given by the board description below.
 enum Pins
 {
     // Outputs - These are all PWM capable
@@ -32,4 +33,64 @@ enum Pins
 
 };
 
+/// @brief  The timer outputs able to drive a PWM pin.
+enum PwmTimer
+{
+    PWM_NONE,
+    PWM_TIMER0A,
+    PWM_TIMER0B,
+    PWM_TIMER1A,
+    PWM_TIMER1B,
+    PWM_TIMER2A,
+    PWM_TIMER2B
+};
+
+/**
+ * Describes the Arduino Nano (ATmega328P) board. Other boards can be supported
+ * by providing a description with the same static members.
+ */
+struct NanoBoard
+{
+    /***************************************************************************
+     * @brief   Gets the timer output that drives a pin, resolved at compile time.
+     *
+     * @param   pin     The pin number
+     *
+     * @return  The timer output, or PWM_NONE if the pin is not PWM capable.
+     */
+    static constexpr PwmTimer pwmTimer(const int pin)
+    {
+        return (pin == 3)  ? PWM_TIMER2B :
+               (pin == 5)  ? PWM_TIMER0B :
+               (pin == 6)  ? PWM_TIMER0A :
+               (pin == 9)  ? PWM_TIMER1A :
+               (pin == 10) ? PWM_TIMER1B :
+               (pin == 11) ? PWM_TIMER2A :
+                             PWM_NONE;
+    }
+};
 
+/*******************************************************************************
+ * @brief   Checks at compile time that there are no pins given.
+ *
+ * @return  True, as there are no pins that are not PWM capable.
+ */
+template <typename Board>
+constexpr bool arePwmPins()
+{
+    return true;
+}
+
+/*******************************************************************************
+ * @brief   Checks at compile time that each of the given pins is PWM capable.
+ *
+ * @param   pin     The first pin to check
+ * @param   pins    The remaining pins to check
+ *
+ * @return  True if all of the pins are PWM capable on the board.
+ */
+template <typename Board, typename... Rest>
+constexpr bool arePwmPins(const int pin, const Rest... pins)
+{
+    return (Board::pwmTimer(pin) != PWM_NONE) && arePwmPins<Board>(pins...);
+}
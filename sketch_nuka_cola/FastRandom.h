@@ -0,0 +1,103 @@
+/**
+ * @file    FastRandom.h
+ *
+ * @brief   Provides a small, fast pseudo random number generator for the
+ *          illumination patterns. Arduino's random() is a 32-bit generator
+ *          needing a 32-bit division for every number, which is slow on an
+ *          8-bit processor. This is a 16-bit xorshift generator, needing only
+ *          shifts and exclusive ors, with numbers in a range taken by a
+ *          multiply rather than a division. Given the same seed, it always
+ *          gives the same sequence, so a random pattern can be reproduced.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+
+/**
+ * 16-bit xorshift pseudo random number generator, with the (7, 9, 8) shift
+ * triplet, which visits every non-zero state before repeating (a period of
+ * 65535).
+ */
+class FastRandom
+{
+public:
+    /***************************************************************************
+     * @brief   Constructor - Seeds the generator.
+     *
+     * @param   seed    The seed
+     */
+    explicit FastRandom(const uint16_t seed = DEFAULT_SEED)
+    : state(DEFAULT_SEED)
+    {
+        setSeed(seed);
+    }
+
+    /***************************************************************************
+     * @brief   Seeds the generator, restarting its sequence.
+     *
+     * @param   seed    The seed. Zero would stop the generator, so is replaced
+     *                  with the default seed.
+     */
+    void setSeed(const uint16_t seed)
+    {
+        state = (seed != 0) ? seed : DEFAULT_SEED;
+    }
+
+    /***************************************************************************
+     * @brief   Gets the next number in the sequence.
+     *
+     * @return  The number, from 1 to 65535.
+     */
+    uint16_t next()
+    {
+        state ^= state << 7;
+        state ^= state >> 9;
+        state ^= state << 8;
+        return state;
+    }
+
+    /***************************************************************************
+     * @brief   Gets the next number in the sequence as a byte.
+     *
+     * @return  The number, from 0 to 255.
+     */
+    byte nextByte()
+    {
+        return next() >> 8;
+    }
+
+    /***************************************************************************
+     * @brief   Gets a number below a given limit, by scaling the next number
+     *          in the sequence with a multiply instead of a division.
+     *
+     * @param   limit   The upper bound (exclusive)
+     *
+     * @return  The number, from 0 to limit - 1.
+     */
+    uint16_t below(const uint16_t limit)
+    {
+        return ((uint32_t)next() * limit) >> 16;
+    }
+
+    /***************************************************************************
+     * @brief   Gets a number within a range, as Arduino's random(min, max).
+     *
+     * @param   low     The lower bound (inclusive)
+     * @param   high    The upper bound (exclusive)
+     *
+     * @return  The number, from low to high - 1.
+     */
+    int between(const int low, const int high)
+    {
+        return low + below(high - low);
+    }
+
+private:
+    /// @brief  The seed used when none, or zero, is given.
+    static const uint16_t DEFAULT_SEED = 0xACE1;
+
+    /// @brief  The current state, which is never zero.
+    uint16_t state;
+};
@@ -9,6 +9,19 @@
  * @date    2020
  */
 #pragma once
+#include <Arduino.h>
+#include "PerfStats.h"
+
+/// @brief  The time in milliseconds an input must read consistently before a
+///         change of state is accepted.
+static const unsigned int DEBOUNCE_TIME_MS = 10;
+
+/// @brief  The number of pin change events each input can queue between polls.
+///         This must be a power of two.
+static const unsigned char INPUT_EVENT_QUEUE_SIZE = 8;
+
+/// @brief  The maximum number of inputs that can be interrupt driven.
+static const unsigned char MAX_INTERRUPT_INPUTS = 4;
 
 /// @brief  Provides the function pointer type definition for the input state handler.
 typedef void (*InputToggleCallback)(
@@ -20,8 +33,23 @@ typedef void (*InputToggleCallback)(
 /// @brief  Provides function pointer type definition for the input
 typedef void (*InputTimeoutCallback)(const int pin, const long durationMs);
 
+/**
+ * Forward declarations.
+ */
+class InputHelper;
+
+/// @brief  The inputs registered for pin change interrupts.
+static InputHelper *interruptInputs[MAX_INTERRUPT_INPUTS];
+
+/// @brief  The number of inputs registered for pin change interrupts.
+static volatile unsigned char interruptInputCount = 0;
+
 /**
  * Class used to make handling input signals easier.
+ * By default, inputs are sampled when polled. Alternatively, an input can be
+ * made interrupt driven, where pin change interrupts time stamp each edge into
+ * a queue that is drained when polled. This means presses are seen as soon as
+ * the loop gets to them, and short taps cannot be missed between polls.
  */
 class InputHelper
 {
@@ -49,44 +77,87 @@ public:
     , timeout_callback(timeout_callback)
     , timeout_duration_ms(timeout_duration_ms)
     , trigger_timeout(true)
+    , inputRegister(portInputRegister(digitalPinToPort(pin)))
+    , bitMask(digitalPinToBitMask(pin))
+    , integrator(lastState ? DEBOUNCE_TIME_MS : 0)
+    , lastSampleMs(lastChangeMs)
+    , interruptDriven(false)
+    , rawState(lastState)
+    , eventHead(0)
+    , eventTail(0)
     {
         pinMode(pin, INPUT);
     }
 
+    /***************************************************************************
+     * @brief   Switches this input to be driven by pin change interrupts. This
+     *          should be called from setup(), and has no effect on boards
+     *          without pin change interrupts.
+     *
+     * @return  True if the input is now interrupt driven, false otherwise.
+     */
+    bool enableInterrupt()
+    {
+#if defined(PCICR)
+        volatile uint8_t * const pcicr = digitalPinToPCICR(pin);
+        if (!interruptDriven &&
+            pcicr != nullptr &&
+            interruptInputCount < MAX_INTERRUPT_INPUTS)
+        {
+            rawState = (*inputRegister & bitMask) ? HIGH : LOW;
+            lastChangeMs = millis();
+            noInterrupts();
+            interruptInputs[interruptInputCount] = this;
+            ++interruptInputCount;
+            *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+            *pcicr |= bit(digitalPinToPCICRbit(pin));
+            interruptDriven = true;
+            interrupts();
+        }
+#endif // PCICR
+        return interruptDriven;
+    }
+
+    /***************************************************************************
+     * @brief   Pin change handler, to be called only from the pin change
+     *          interrupt service routines. Each registered input whose pin has
+     *          changed has the new state queued, time stamped.
+     */
+    static void handlePinChange()
+    {
+        const unsigned long timeMs = millis();
+        for (unsigned char i = 0; i < interruptInputCount; ++i)
+        {
+            interruptInputs[i]->queueEdge(timeMs);
+        }
+    }
+
     /***************************************************************************
      * @brief   Polls event, to be called in the loop() function. Checks the
      *          current state of the input and signals the toggle callback if
      *          the state has changed since the last poll.
+     *          This never blocks.
      */
     void poll()
     {
-        // Read twice with short delay to remove any button bounce
+        PERF_SCOPE(PerfInputs);
         const long currentTimeMs = millis();
-        const int a = digitalRead(pin);
-        delay(10);
-        const int b = digitalRead(pin);
-        if (a == b)
+        if (interruptDriven)
         {
-            const long duration = currentTimeMs - lastChangeMs;
-            if (a != lastState)
-            {
-                signalToggleCallback(pin, a, duration);
-
-                lastState = a;
-                lastChangeMs = currentTimeMs;
-                // If we're now toggled off, reset the time-out trigger
-                if (lastState)
-                {
-                    trigger_timeout = true;
-                }
-            }
-            else if (trigger_timeout &&
-                lastState &&
-                (duration >= timeout_duration_ms))
-            {
-                trigger_timeout = false;
-                signalTimeoutCallback(pin, duration);
-            }
+            pollEvents(currentTimeMs);
+        }
+        else
+        {
+            pollSample(currentTimeMs);
+        }
+
+        const long duration = currentTimeMs - lastChangeMs;
+        if (trigger_timeout &&
+            lastState &&
+            (duration >= timeout_duration_ms))
+        {
+            trigger_timeout = false;
+            signalTimeoutCallback(pin, duration);
         }
     }
 
@@ -135,6 +206,123 @@ public:
 
 
 protected:
+    /// @brief  A time stamped change of input state.
+    struct InputEvent
+    {
+        // The state of the input after the change
+        unsigned char state;
+        // The time of the change in milliseconds
+        unsigned long timeMs;
+    };
+
+    /***************************************************************************
+     * @brief   Samples the input and de-bounces it by integrating the time it
+     *          has read high or low; a change of state is only accepted once
+     *          it has read consistently for the de-bounce time. Each sample is
+     *          limited to half of the de-bounce time, so at least two agreeing
+     *          samples are needed however slowly this is polled.
+     *
+     * @param   currentTimeMs   The time of this poll
+     */
+    void pollSample(const long currentTimeMs)
+    {
+        const unsigned int step = min(
+            (unsigned long)(currentTimeMs - lastSampleMs),
+            (unsigned long)(DEBOUNCE_TIME_MS / 2)
+        );
+        lastSampleMs = currentTimeMs;
+        if (*inputRegister & bitMask)
+        {
+            integrator = min(integrator + step, DEBOUNCE_TIME_MS);
+            if (integrator == DEBOUNCE_TIME_MS)
+            {
+                changeState(HIGH, currentTimeMs);
+            }
+        }
+        else
+        {
+            integrator = (integrator > step) ? integrator - step : 0;
+            if (integrator == 0)
+            {
+                changeState(LOW, currentTimeMs);
+            }
+        }
+    }
+
+    /***************************************************************************
+     * @brief   Drains the queued pin change events. The first edge after a
+     *          quiet period is accepted immediately, then further edges are
+     *          ignored for the de-bounce time. Once that time has passed, the
+     *          input settles to its current state, in case the final edge fell
+     *          within the ignored bounces.
+     *
+     * @param   currentTimeMs   The time of this poll
+     */
+    void pollEvents(const long currentTimeMs)
+    {
+        while (eventTail != eventHead)
+        {
+            const volatile InputEvent &event = events[eventTail];
+            if ((long)(event.timeMs - lastChangeMs) >= (long)DEBOUNCE_TIME_MS)
+            {
+                changeState(event.state, event.timeMs);
+            }
+            eventTail = (eventTail + 1) & (INPUT_EVENT_QUEUE_SIZE - 1);
+        }
+        if ((currentTimeMs - lastChangeMs) >= (long)DEBOUNCE_TIME_MS)
+        {
+            changeState(rawState, currentTimeMs);
+        }
+    }
+
+    /***************************************************************************
+     * @brief   Accepts a de-bounced state, signalling the toggle callback if it
+     *          differs from the current state.
+     *
+     * @param   state   The de-bounced state of the input
+     * @param   timeMs  The time of the change
+     */
+    void changeState(const int state, const long timeMs)
+    {
+        if (state != lastState)
+        {
+            signalToggleCallback(pin, state, timeMs - lastChangeMs);
+
+            lastState = state;
+            lastChangeMs = timeMs;
+            // If we're now toggled off, reset the time-out trigger
+            if (lastState)
+            {
+                trigger_timeout = true;
+            }
+        }
+    }
+
+    /***************************************************************************
+     * @brief   Queues the state of the input if it has changed, called from the
+     *          pin change interrupt. This is the only producer for the event
+     *          queue, and poll() the only consumer, so no locking is required.
+     *          If the queue is full, the event is dropped; the input will still
+     *          settle to the correct state once polled.
+     *
+     * @param   timeMs  The time of the interrupt
+     */
+    void queueEdge(const unsigned long timeMs)
+    {
+        const unsigned char state = (*inputRegister & bitMask) ? HIGH : LOW;
+        if (state != rawState)
+        {
+            rawState = state;
+            const unsigned char next = (eventHead + 1) & (INPUT_EVENT_QUEUE_SIZE - 1);
+            if (next != eventTail)
+            {
+                events[eventHead].state = state;
+                events[eventHead].timeMs = timeMs;
+                eventHead = next;
+            }
+        }
+    }
+
     /// @brief  The input pin to monitor
     const int pin;
     /// @brief  The toggle callback for handling state changes
@@ -150,5 +338,45 @@ protected:
     long timeout_duration_ms;
     /// @brief  Indicates whether to send the time-out callback
     bool trigger_timeout;
+    /// @brief  The input register of the port the pin belongs to. Reading this
+    ///         directly saves the pin look ups carried out by digitalRead().
+    volatile uint8_t *inputRegister;
+    /// @brief  The bit mask of the pin within its port.
+    uint8_t bitMask;
+    /// @brief  The de-bounce integrator, counting from zero (low) up to the
+    ///         de-bounce time (high).
+    unsigned int integrator;
+    /// @brief  The time of the last sample.
+    long lastSampleMs;
+    /// @brief  Whether this input is driven by pin change interrupts.
+    bool interruptDriven;
+    /// @brief  The raw (not de-bounced) state seen by the last interrupt.
+    volatile unsigned char rawState;
+    /// @brief  The queue of pin change events, written by the interrupt.
+    volatile InputEvent events[INPUT_EVENT_QUEUE_SIZE];
+    /// @brief  The index the next event will be queued at.
+    volatile unsigned char eventHead;
+    /// @brief  The index of the next event to be drained.
+    volatile unsigned char eventTail;
 };
 
+#if defined(PCICR)
+/**
+ * Pin change interrupt service routines. Each port's interrupt is handled in
+ * the same way, as the registered inputs check their own pins.
+ */
+ISR(PCINT0_vect)
+{
+    InputHelper::handlePinChange();
+}
+
+ISR(PCINT1_vect)
+{
+    InputHelper::handlePinChange();
+}
+
+ISR(PCINT2_vect)
+{
+    InputHelper::handlePinChange();
+}
+#endif // PCICR
@@ -13,19 +13,68 @@
  * @date    2020
  */
 #pragma once
+#include <Arduino.h>
 #include <string.h>
+#include <limits.h>
+#include <avr/pgmspace.h>
+#include "Common.h"
 #include "NonVol.h"
+#include "FastRandom.h"
+#include "PatternMath.h"
+#include "PatternKernels.h"
+#include "PerfStats.h"
 
 /**
  * Constants
  */
 
 /// @brief  The settings version number.
-#define VERSION     (1)
+#define VERSION     (4)
 
 /// @brief  The minimum settle time for setting the LED PWM values.
 static const long MIN_SETTLE_TIME = 20;
 
+/// @brief  The number of timer 2 overflows per frame. Timer 2 runs in phase
+///         correct PWM mode with a prescaler of 64, overflowing every 510
+///         timer clocks (2.04ms at 16MHz), so this gives a frame every 20.4ms.
+///         Where timer 2 is not available, MIN_SETTLE_TIME is used instead.
+static const unsigned char FRAME_TICKS = 10;
+
+/// @brief  Duty cycles are written straight to the output compare registers
+///         where timers 0, 1 and 2 each drive two PWM pins, as on the Nano.
+///         Other boards use analogWrite().
+#if defined(OCR0A) && defined(OCR0B) && defined(OCR1A) && \
+    defined(OCR1B) && defined(OCR2A) && defined(OCR2B)
+#define DIRECT_PWM_OUTPUT
+#endif // Timer check
+
+/// @brief  The time in milliseconds that the settings must remain unchanged
+///         before they are committed to EEPROM. This prevents button presses
+///         and serial commands in quick succession each wearing the EEPROM.
+static const unsigned long SETTINGS_COMMIT_DELAY_MS = 3000;
+
+/// @brief  The first EEPROM address of the region the settings are stored in.
+static const int SETTINGS_EEPROM_START = 0;
+
+/// @brief  The number of record slots in the EEPROM region the settings are
+///         stored in. Each commit is written to the next slot, spreading the
+///         wear over all of them, so this is the factor by which the wear on
+///         each EEPROM cell is reduced.
+static const int SETTINGS_EEPROM_SLOTS = 21;
+
+/// @brief  The number of milliseconds in a minute.
+static const unsigned long MS_PER_MINUTE = 60000;
+
+/// @brief  The phase accumulator increment per millisecond for each revolution
+///         per minute. The accumulator is a 32-bit binary angle, where 2^32 is
+///         one full revolution, so this is the whole part of 2^32 / 60000.
+static const unsigned long PHASE_INCREMENT_PER_RPM = 71582;
+
+/// @brief  The remainder of 2^32 / 60000, in 60000ths of the accumulator's
+///         least significant bit. This is carried between advances, so the
+///         phase does not drift from the time elapsed.
+static const unsigned long PHASE_REMAINDER_PER_RPM = 47296;
+
 /// @brief  This look up table provides the brightness as a whole percentage
 ///         to the equivalent 8-bit duty cycle. As apparent brightness is more
 ///         logarithmic than linear, the values here show a logarithmic
@@ -45,59 +94,90 @@ static const byte BRIGHTNESS_TO_DUTY_CYCLE[] =
  184, 189, 195, 201, 207, 214, 221, 229, 237, 245, 255
 };
 
-/**
- * Forward declarations.
- */
-class LedCluster;
-
 /**
  * Structures, enumerations and type definitions.
  */
 
-/// @brief  Provides the available LED illumination patterns.
+/// @brief  Provides the available LED illumination patterns. Patterns that
+///         are not built in (see PatternKernels.h) are left out, so the indices
+///         are always contiguous.
 enum Patterns
 {
     JustOn,
+#if defined(PATTERN_CHASE)
     // Chasing - The lead LED comes on at full brightness,
     // and dims as the head of the circle moves around
     ChaseClockwise,
     ChaseAntiClockwise,
     ChaseBoth,
+#endif // PATTERN_CHASE
+#if defined(PATTERN_WAVE)
     // The peak of the circle is brightest, with the area surrounding it
     // dimming gently to nothing at 180 degrees away
     WaveClockwise,
     WaveAntiClockwise,
+#endif // PATTERN_WAVE
+#if defined(PATTERN_THROB)
     // The lights all throb from off to on
     Throb,
     // Another throb mode with some flicker
     Throb2,
+#endif // PATTERN_THROB
+#if defined(PATTERN_HEARTBEAT)
     // Heart beat effect, two pulses per revolution
     Heartbeat,
+#endif // PATTERN_HEARTBEAT
+#if defined(PATTERN_RAINDROP)
     // Each light randomly lights up quickly then fades once per revolution
     Raindrop,
+#endif // PATTERN_RAINDROP
+#if defined(PATTERN_FLAMES)
     // Rough attempt at a candle flicker
     Flames,
+#endif // PATTERN_FLAMES
+#if defined(PATTERN_STATIC)
     // Fairly random flickering
     Static,
+#endif // PATTERN_STATIC
+#if defined(PATTERN_PARTICLES)
+    // Overlapping raindrops falling at random
+    Drops,
+    // Comets travelling around the ring in either direction
+    Comets,
+    // Sparks flashing at random then dying away
+    Sparks,
+#endif // PATTERN_PARTICLES
 
     PATTERN_COUNT
 };
 
-/// @brief  Strings for each pattern available.
-const String PATTERN_STRINGS[Patterns::PATTERN_COUNT] =
+/// @brief  The pattern selected on a clean upload.
+#if defined(PATTERN_CHASE)
+static const Patterns DEFAULT_PATTERN = Patterns::ChaseClockwise;
+#else
+static const Patterns DEFAULT_PATTERN = Patterns::JustOn;
+#endif // PATTERN_CHASE
+
+/// @brief  The settings of a pattern layer, drawn over the main pattern.
+struct LayerSettings
+{
+    // The illumination pattern drawn by the layer
+    byte pattern;
+    // The BlendMode used to blend the layer with the levels beneath it
+    byte blend;
+    // The opacity of the layer as a percentage
+    byte opacity;
+    // The speed of the layer in revolutions per minute
+    byte revsPerMinute;
+};
+
+/// @brief  Constants for the pattern layers drawn over the main pattern.
+enum LayerConstants
 {
-    "Just On",
-    "Chase Clockwise",
-    "Chase AntiClockwise",
-    "Chase Both",
-    "Wave Clockwise",
-    "Wave AntiClockwise",
-    "Throb",
-    "Throb Two",
-    "Heartbeat",
-    "Raindrop",
-    "Flames",
-    "Static",
+    // The number of layers that can be drawn over the main pattern
+    MAX_LAYERS = 2,
+    // The default opacity of a layer as a percentage
+    DEFAULT_LAYER_OPACITY = 50,
 };
 
 /// @brief  The settings object, stored in non-volatile memory so that the
@@ -113,38 +193,26 @@ struct Settings
     // The speed of the illumination patterns determined by how many revolutions
     // per minute around the "circle".
     int revsPerMinute;
+    // The time taken to crossfade from one pattern to the next in milliseconds
+    int transitionMs;
+    // The pattern layers drawn over the main pattern, from the bottom up
+    LayerSettings layers[LayerConstants::MAX_LAYERS];
+    // The density of the particle patterns as a percentage
+    int particleDensity;
     // Unwritten EEPROM bytes are all 0xFF. This boolean value will help identify
     // when a fresh read is done. It will not protect against structure changes.
     byte invalid;
 };
 
-/// @brief  Information representing the current position of the "lead" point
-///         of the circle during a revolution.
-struct LightLocationInfo
-{
-    // The current angle in degrees
-    float angle;
-    // The revolution number, good for identifying when a new cycle has started
-    long revolution;
-};
-
-/// @brief  Information about each LED, allowing different illumination patterns
-///         to be carried out.
-struct LedInfo
-{
-    int index;
-    float angle;
-    int brightness;
-    int pin;
-    int extra;
-};
+/// @brief  The size of the EEPROM region the settings are stored in, sized to
+///         hold the settings slots whatever the size of the settings.
+static const int SETTINGS_EEPROM_LENGTH =
+    WearLevelledNonVol<Settings>::regionLength(SETTINGS_EEPROM_SLOTS);
 
-/// @brief  Type definition for an illumination pattern method.
-typedef void (LedCluster::*PatternMethod)
-(
-    LedInfo * const,
-    const LightLocationInfo * const
-);
+static_assert(SETTINGS_EEPROM_SLOTS >= WearLevelledNonVol<Settings>::MIN_SLOTS,
+              "The settings need more slots to be wear levelled");
+static_assert(SETTINGS_EEPROM_START + SETTINGS_EEPROM_LENGTH <= E2END + 1,
+              "The settings slots must fit in EEPROM");
 
 /// @brief  Constants required for calculating the current brightnesses of
 ///         LEDs. These will be used to add a range to the maximum brightness
@@ -184,71 +252,477 @@ enum SpeedConstants
     MAX_SPEED_PCT = 100,
 };
 
-/// @brief  Constants required to create a raindrop effect.
-enum RaindropConstants
+/// @brief  Constants for the crossfade between patterns when the pattern is
+///         changed.
+enum TransitionConstants
+{
+    // The shortest transition, which cuts straight to the new pattern
+    MIN_TRANSITION_MS = 0,
+    // The longest transition in milliseconds
+    MAX_TRANSITION_MS = 5000,
+    // The number of milliseconds to increase by per step
+    TRANSITION_STEP_MS = 250,
+    // The default transition on a clean upload
+    DEFAULT_TRANSITION_MS = 1000,
+};
+
+/// @brief  Constants for the density of the particle patterns.
+enum DensityConstants
+{
+    // The lowest density percentage, where no particles are spawned
+    MIN_DENSITY = 0,
+    // The highest density percentage
+    MAX_DENSITY = 100,
+    // The percentage to increase by per step
+    DENSITY_STEP = 10,
+    // The default density on a clean upload
+    DEFAULT_DENSITY = 50,
+};
+
+/// @brief  Flags describing the behaviour of a pattern.
+enum PatternFlags
+{
+    // The pattern moves at the speed setting
+    PATTERN_USES_SPEED = 0x01,
+    // The pattern uses the random number generator
+    PATTERN_USES_RNG = 0x02,
+    // The pattern is drawn with particles, at the density setting
+    PATTERN_USES_PARTICLES = 0x04,
+};
+
+/// @brief  The longest pattern name, including the null terminator.
+static const byte PATTERN_NAME_LENGTH = 20;
+
+/// @brief  Describes an illumination pattern, and provides the functions that
+///         draw it. These are stored in flash, and must be read with the
+///         pgm_read_* functions or the accessors below.
+struct PatternInfo
+{
+    // The name of the pattern, null terminated
+    char name[PATTERN_NAME_LENGTH];
+    // The PatternFlags that apply
+    byte flags;
+    // Draws each frame
+    PatternKernel render;
+    // Called at the start of each revolution before drawing, or null
+    PatternKernel onRevolution;
+    // Called when the pattern is selected or started, or null
+    PatternKernel onSelect;
+};
+
+/// @brief  The registry of patterns, in the order of the Patterns enumeration.
+static const PatternInfo PATTERN_CATALOG[Patterns::PATTERN_COUNT] PROGMEM =
+{
+    {
+        "Just On", 0,
+        justOn, nullptr, nullptr
+    },
+#if defined(PATTERN_CHASE)
+    {
+        "Chase Clockwise", PATTERN_USES_SPEED,
+        chaseModeCw, nullptr, nullptr
+    },
+    {
+        "Chase AntiClockwise", PATTERN_USES_SPEED,
+        chaseModeAcw, nullptr, nullptr
+    },
+    {
+        "Chase Both", PATTERN_USES_SPEED,
+        chaseModeBoth, nullptr, nullptr
+    },
+#endif // PATTERN_CHASE
+#if defined(PATTERN_WAVE)
+    {
+        "Wave Clockwise", PATTERN_USES_SPEED,
+        waveModeCw, nullptr, nullptr
+    },
+    {
+        "Wave AntiClockwise", PATTERN_USES_SPEED,
+        waveModeAcw, nullptr, nullptr
+    },
+#endif // PATTERN_WAVE
+#if defined(PATTERN_THROB)
+    {
+        "Throb", PATTERN_USES_SPEED,
+        throbMode, nullptr, nullptr
+    },
+    {
+        "Throb Two", PATTERN_USES_SPEED,
+        throbMode2, nullptr, nullptr
+    },
+#endif // PATTERN_THROB
+#if defined(PATTERN_HEARTBEAT)
+    {
+        "Heartbeat", PATTERN_USES_SPEED,
+        heartbeatMode, nullptr, nullptr
+    },
+#endif // PATTERN_HEARTBEAT
+#if defined(PATTERN_RAINDROP)
+    {
+        "Raindrop", PATTERN_USES_SPEED | PATTERN_USES_RNG,
+        raindropMode, populateRaindrops, populateRaindrops
+    },
+#endif // PATTERN_RAINDROP
+#if defined(PATTERN_FLAMES)
+    {
+        "Flames", PATTERN_USES_SPEED | PATTERN_USES_RNG,
+        candleMode, nullptr, seedFlames
+    },
+#endif // PATTERN_FLAMES
+#if defined(PATTERN_STATIC)
+    {
+        "Static", PATTERN_USES_SPEED | PATTERN_USES_RNG,
+        staticMode, nullptr, seedFlames
+    },
+#endif // PATTERN_STATIC
+#if defined(PATTERN_PARTICLES)
+    {
+        "Drops",
+        PATTERN_USES_SPEED | PATTERN_USES_RNG | PATTERN_USES_PARTICLES,
+        dropsMode, nullptr, resetParticles
+    },
+    {
+        "Comets",
+        PATTERN_USES_SPEED | PATTERN_USES_RNG | PATTERN_USES_PARTICLES,
+        cometsMode, nullptr, resetParticles
+    },
+    {
+        "Sparks",
+        PATTERN_USES_SPEED | PATTERN_USES_RNG | PATTERN_USES_PARTICLES,
+        sparksMode, nullptr, resetParticles
+    },
+#endif // PATTERN_PARTICLES
+};
+
+/*******************************************************************************
+ * @brief   Gets the name of a pattern, for printing straight from flash.
+ *
+ * @param   pattern     The pattern index, which must be valid
+ *
+ * @return  The pattern name in flash.
+ */
+static inline const __FlashStringHelper *getPatternName(const int pattern)
+{
+    return (const __FlashStringHelper *)PATTERN_CATALOG[pattern].name;
+}
+
+/*******************************************************************************
+ * @brief   Gets the flags describing a pattern.
+ *
+ * @param   pattern     The pattern index, which must be valid
+ *
+ * @return  The PatternFlags that apply to the pattern.
+ */
+static inline byte getPatternFlags(const int pattern)
+{
+    return pgm_read_byte(&PATTERN_CATALOG[pattern].flags);
+}
+
+/*******************************************************************************
+ * @brief   Gets the function that draws each frame of a pattern.
+ *
+ * @param   pattern     The pattern index, which must be valid
+ *
+ * @return  The render kernel.
+ */
+static inline PatternKernel getPatternRender(const int pattern)
+{
+    return (PatternKernel)pgm_read_ptr(&PATTERN_CATALOG[pattern].render);
+}
+
+/*******************************************************************************
+ * @brief   Gets the function called at the start of each revolution of a
+ *          pattern.
+ *
+ * @param   pattern     The pattern index, which must be valid
+ *
+ * @return  The revolution hook, or null if there is none.
+ */
+static inline PatternKernel getPatternRevolutionHook(const int pattern)
+{
+    return (PatternKernel)pgm_read_ptr(&PATTERN_CATALOG[pattern].onRevolution);
+}
+
+/*******************************************************************************
+ * @brief   Gets the function called when a pattern is selected or started.
+ *
+ * @param   pattern     The pattern index, which must be valid
+ *
+ * @return  The select hook, or null if there is none.
+ */
+static inline PatternKernel getPatternSelectHook(const int pattern)
+{
+    return (PatternKernel)pgm_read_ptr(&PATTERN_CATALOG[pattern].onSelect);
+}
+
+/// @brief  The position of the lead point of a pattern around the circle,
+///         which advances with time at the speed of the pattern.
+struct PatternClock
+{
+    // The position of the lead point as a 32-bit binary angle, where 2^32 is
+    // one full revolution
+    uint32_t phaseAccumulator;
+    // The fraction of the accumulator's least significant bit carried from the
+    // last advance, in 60000ths
+    unsigned int phaseRemainder;
+    // The amount the phase accumulator advances per millisecond
+    unsigned long phaseIncrement;
+    // The fraction of a bit the accumulator advances per millisecond, on top
+    // of the increment, in 60000ths
+    unsigned int incrementRemainder;
+    // The speed in revolutions per minute
+    int revsPerMinute;
+    // The number of complete revolutions since starting
+    long revolution;
+};
+
+/*******************************************************************************
+ * @brief   Sets the speed of a pattern clock. The phase itself is left
+ *          untouched, so speed changes do not cause the pattern to jump.
+ *
+ * @param   clock           The clock to update
+ * @param   revsPerMinute   The speed in revolutions per minute
+ */
+static inline void setClockSpeed(PatternClock &clock, const int revsPerMinute)
+{
+    const unsigned long remainder = PHASE_REMAINDER_PER_RPM * revsPerMinute;
+    clock.revsPerMinute = revsPerMinute;
+    clock.phaseIncrement = (PHASE_INCREMENT_PER_RPM * revsPerMinute) + (remainder / MS_PER_MINUTE);
+    clock.incrementRemainder = remainder % MS_PER_MINUTE;
+}
+
+/*******************************************************************************
+ * @brief   Moves a pattern clock back to the start of the first revolution.
+ *
+ * @param   clock   The clock to reset
+ */
+static inline void resetClock(PatternClock &clock)
+{
+    clock.phaseAccumulator = 0;
+    clock.phaseRemainder = 0;
+    clock.revolution = 0;
+}
+
+/*******************************************************************************
+ * @brief   Advances a pattern clock by the time elapsed, and updates a pattern
+ *          context with the new position of the lead point.
+ *
+ * @param   clock       The clock to advance
+ * @param   elapsedMs   The time elapsed in milliseconds
+ * @param   context     The pattern context to update
+ *
+ * @return  True if a new revolution has started, false otherwise.
+ */
+static inline bool advanceClock(
+    PatternClock &clock,
+    unsigned long elapsedMs,
+    PatternContext &context
+)
 {
-    // The number of degrees the raindrop will appear over
-    RAINDROP_ANGLE = 12,
-    // The number of degrees the raindrop will take to brighten
-    RAMPUP_ANGLE = 3,
-    // The number of degrees the raindrop will fade over
-    RAMPDOWN_ANGLE = RAINDROP_ANGLE - RAMPUP_ANGLE
+    const long startRevolution = clock.revolution;
+    // Each whole minute is a whole number of revolutions, leaving the phase
+    // where it was. These are removed first, so the products below cannot
+    // overflow. This only happens after a long stall.
+    if (elapsedMs >= MS_PER_MINUTE)
+    {
+        clock.revolution += (elapsedMs / MS_PER_MINUTE) * clock.revsPerMinute;
+        elapsedMs %= MS_PER_MINUTE;
+    }
+    // Then the whole revolutions within the time left, after which the phase
+    // moves on by less than a revolution, and only wraps if it passes zero
+    clock.revolution += (elapsedMs * clock.revsPerMinute) / MS_PER_MINUTE;
+    const unsigned long remainder =
+        clock.phaseRemainder + (elapsedMs * clock.incrementRemainder);
+    clock.phaseRemainder = remainder % MS_PER_MINUTE;
+    const uint32_t previous = clock.phaseAccumulator;
+    clock.phaseAccumulator += (elapsedMs * clock.phaseIncrement) + (remainder / MS_PER_MINUTE);
+    if (clock.phaseAccumulator < previous)
+    {
+        ++clock.revolution;
+    }
+    context.phase = clock.phaseAccumulator >> 16;
+    context.angle = ((unsigned long)context.phase * 360) >> 16;
+    context.revolution = clock.revolution;
+    return clock.revolution != startRevolution;
+}
+
+/// @brief  Statistics on the interval between frames, in microseconds.
+struct FrameStats
+{
+    // The shortest interval
+    unsigned long minUs;
+    // The longest interval
+    unsigned long maxUs;
+    // The sum of all intervals, for calculating the mean
+    unsigned long totalUs;
+    // The number of intervals measured
+    unsigned long count;
 };
 
+/// @brief  The PWM output writes made while running a pattern.
+struct PatternOutputStats
+{
+    // The number of output writes
+    unsigned long writes;
+    // The time spent running the pattern in milliseconds
+    unsigned long timeMs;
+};
+
+/// @brief  Type definition for a function receiving the frames of a pattern
+///         trace.
+///
+/// @param  pattern     The pattern index traced
+/// @param  frame       The frame number, from zero
+/// @param  dutyCycles  The duty cycle of each LED
+/// @param  count       The number of LEDs
+typedef void (*TraceHandler)(
+    int pattern,
+    unsigned int frame,
+    const byte *dutyCycles,
+    int count
+);
+
+/// @brief  The number of timer 2 overflows since the last frame.
+static volatile unsigned char frameTicks = 0;
+
+/// @brief  Set by the timer 2 overflow interrupt when a frame is due.
+static volatile bool frameDue = false;
+
+#if defined(TIMSK2)
+/// @brief  Commits the pending frame of the cluster driven by the frame tick.
+static void (*frameTickHandler)() = nullptr;
+#endif // TIMSK2
+
 /*******************************************************************************
  * @brief   The LedCluster class, used to set LED brightnesses to form different
- *          patterns.
+ *          patterns. All of the storage for the LEDs is held within the class,
+ *          so a cluster can be statically allocated without using the heap.
+ *          The pins are fixed at compile time, so the timer output driving
+ *          each one is resolved by the compiler, and the loops over the
+ *          outputs are unrolled into direct register writes.
+ *
+ * @tparam  Board   The board description, providing the pin to timer map
+ * @tparam  LedPins The pins driving the LEDs, in order around the circle
  */
+template <typename Board, byte... LedPins>
 class LedCluster
 {
+    static_assert(sizeof...(LedPins) > 0, "An LED cluster needs at least one LED");
+    static_assert(arePwmPins<Board>(LedPins...), "Every LED pin must be PWM capable");
+
 public:
 
+    /// @brief  The number of LEDs within this cluster.
+    static const int LED_COUNT = sizeof...(LedPins);
+
     /***************************************************************************
-     * @brief   Constructor - Populates the list of LED pins
-     *
-     * @param   pins    Pointer to the collection of pin IDs
-     * @param   count   The number of LEDs in this cluster
+     * @brief   Constructor - Sets up the LEDs and the pattern contexts. The
+     *          hardware is left alone until begin() is called, as for a global
+     *          cluster this runs before the Arduino core has been initialised.
      */
-    LedCluster(const byte * const pins, const int count)
-    : leds(nullptr)
-    , count(count)
-    , startTimeMs(millis())
-    , settingsNV(0)
-    , running(true)
-    , lastPoll(millis())
+    LedCluster()
+    : backBuffer(0)
+    , pendingFrame(nullptr)
+    , lastPhaseUpdateMs(0)
+    , settingsNV(
+        SETTINGS_EEPROM_START,
+        SETTINGS_EEPROM_LENGTH,
+        SETTINGS_COMMIT_DELAY_MS
+    )
+    , running(false)
+    , lastPoll(0)
+    , transitioning(false)
+    , outgoingFrozen(false)
+    , crossfadeDrawn(false)
+    , randomSeed(0)
     {
-        // Set up the LEDs
-        const float angle = 360.0f / count;
-        leds = new LedInfo[count];
-        for (int i = 0; i < count; ++i)
+        // Set up the LEDs, spread evenly around the circle
+        for (int i = 0; i < LED_COUNT; ++i)
         {
-            leds[i].index = i;
-            leds[i].angle = angle * i;
-            leds[i].brightness = 0;
-            leds[i].pin = pins[i];
+            ledPhases[i] = ((unsigned long)i << 16) / LED_COUNT;
+            ledExtras[i] = 0;
+            ledLevels[i] = 0;
         }
-        populateRaindrops();
-        // Load the settings and check they are valid, set to defaults if not
-        settings = settingsNV;
-        if (settings.invalid || settings.version != VERSION)
+        context.angle = 0;
+        context.phase = 0;
+        context.revolution = 0;
+        context.count = LED_COUNT;
+        context.ledPhases = ledPhases;
+        context.extras = ledExtras;
+        context.levels = ledLevels;
+        context.density = 0;
+        context.particles = getParticlePool(MAIN_POOL);
+        context.rng = &rng;
+        outgoingContext = context;
+        outgoingContext.extras = outgoingExtras;
+        outgoingContext.levels = outgoingLevels;
+        outgoingContext.particles = getParticlePool(OUTGOING_POOL);
+        resetClock(clock);
+        for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
         {
-            settings.version = VERSION;
-            settings.pattern = Patterns::ChaseClockwise;
-            settings.brightnessMultiplier = BrightnessConstants::DEFAULT_BRIGHTNESS;
-            settings.revsPerMinute = SpeedConstants::DEFAULT_SPEED;
-            settings.invalid = 0;
-            settingsNV = settings;
+            layerContexts[l] = context;
+            layerContexts[l].extras = layerExtras[l];
+            layerContexts[l].levels = layerLevels;
+            layerContexts[l].particles = getParticlePool(FIRST_LAYER_POOL + l);
+            resetClock(layerClocks[l]);
         }
-        // Calculate the current time period of the illumination pattern
-        revTimePeriodMs = ((1000.0f * 60.0f) / settings.revsPerMinute);
+        memset(frameBuffers, 0, sizeof(frameBuffers));
+        patternTimeUs = 0;
+        memset(outputStats, 0, sizeof(outputStats));
     }
 
     /***************************************************************************
-     * @brief   Destructor.
+     * @brief   Sets up the outputs, loads the settings, starts the frame tick
+     *          and starts the illumination pattern from the beginning. This is
+     *          to be called from setup().
      */
-    virtual ~LedCluster()
+    void begin()
     {
-        delete[] leds;
+        // Set up the PWM outputs and the front and back frame buffers
+        noInterrupts();
+        pendingFrame = nullptr;
+        memset(frameBuffers, 0, sizeof(frameBuffers));
+        interrupts();
+        const bool unrolled[] = { (setupOutput<LedPins>(), true)... };
+        (void)unrolled;
+        // Check the settings are valid and set to defaults if not. The pattern
+        // may be out of range if the patterns built in have changed.
+        settingsNV.load();
+        if (settingsNV->invalid ||
+            settingsNV->version != VERSION ||
+            settingsNV->pattern < 0 ||
+            settingsNV->pattern >= Patterns::PATTERN_COUNT ||
+            !layersValid(settingsNV))
+        {
+            Settings settings;
+            settings.version = VERSION;
+            settings.pattern = DEFAULT_PATTERN;
+            settings.brightnessMultiplier = BrightnessConstants::DEFAULT_BRIGHTNESS;
+            settings.revsPerMinute = SpeedConstants::DEFAULT_SPEED;
+            settings.transitionMs = TransitionConstants::DEFAULT_TRANSITION_MS;
+            for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
+            {
+                settings.layers[l].pattern = Patterns::JustOn;
+                settings.layers[l].blend = BlendMode::BLEND_OFF;
+                settings.layers[l].opacity = LayerConstants::DEFAULT_LAYER_OPACITY;
+                settings.layers[l].revsPerMinute = SpeedConstants::DEFAULT_SPEED;
+            }
+            settings.particleDensity = DensityConstants::DEFAULT_DENSITY;
+            settings.invalid = 0;
+            settingsNV = settings;
+        }
+        updatePhaseIncrement();
+        updateDutyCycles();
+        updateDensity();
+#if defined(TIMSK2)
+        // Start the frame tick
+        tickCluster = this;
+        frameTickHandler = &LedCluster::commitTickedFrame;
+        TIMSK2 |= _BV(TOIE2);
+#endif // TIMSK2
+        restartPatterns();
+        resetFrameStats();
+        running = true;
     }
 
     /***************************************************************************
@@ -286,93 +760,289 @@ public:
      *          current run time and calculates what the illumination levels of
      *          each LED should be based on their position, the pattern and
      *          other factors.
+     *          This never blocks; the LEDs are only updated when the frame
+     *          tick says a frame is due, otherwise this returns immediately so
+     *          other work can carry on.
+     *          Whilst crossfading from one pattern to the next, both patterns
+     *          are drawn and blended together. Any pattern layers are then
+     *          drawn over the top.
      */
     void poll()
     {
-        static long lastRevolution = 0;
-        if (running)
+        PERF_SCOPE(PerfLeds);
+        settingsNV.poll();
+        if (running && takeFrame())
         {
-            // Ensure the LED PWMs have had enough settle time
-            while (millis() - lastPoll < MIN_SETTLE_TIME)
+            const unsigned long elapsedMs = takeElapsedMs();
+            const bool newRevolution = advanceClock(clock, elapsedMs, context);
+            drawPattern(settingsNV->pattern, context, newRevolution);
+            if (transitioning)
             {
-                delay(1);
+                const unsigned long fadeMs = millis() - transitionStartMs;
+                const unsigned long durationMs = settingsNV->transitionMs;
+                if (fadeMs >= durationMs)
+                {
+                    transitioning = false;
+                }
+                else
+                {
+                    if (!outgoingFrozen)
+                    {
+                        outgoingContext.angle = context.angle;
+                        outgoingContext.phase = context.phase;
+                        outgoingContext.revolution = context.revolution;
+                        drawPattern(outgoingPattern, outgoingContext, newRevolution);
+                    }
+                    crossfadeLevels(context, outgoingLevels, (fadeMs << 8) / durationMs);
+                    memcpy(crossfadedLevels, ledLevels, sizeof(crossfadedLevels));
+                    crossfadeDrawn = true;
+                }
             }
-            lastPoll = millis();
-            LightLocationInfo info;
-            getCurrentLightInfo(&info);
-            PatternMethod method = nullptr;
-            // Identify the required pattern method. Whilst this could be
-            // pushed into an array, that would require additional handling
-            // for invalid indices, and special conditions for patterns that
-            // require additional functions to be carried out on occasion.
-            switch (settings.pattern)
-            {
-
-                case Patterns::ChaseClockwise:
-                    method = &LedCluster::chaseModeCw;
-                    break;
-
-                case Patterns::ChaseAntiClockwise:
-                    method = &LedCluster::chaseModeAcw;
-                    break;
-
-                case Patterns::ChaseBoth:
-                    method = &LedCluster::chaseModeBoth;
-                    break;
-
-                case Patterns::WaveClockwise:
-                    method = &LedCluster::waveModeCw;
-                    break;
-
-                case Patterns::WaveAntiClockwise:
-                    method = &LedCluster::waveModeAcw;
-                    break;
+            drawLayers(elapsedMs);
+            updateLedBrightnesses();
+        }
+    }
 
-                case Patterns::Throb:
-                    method = &LedCluster::throbMode;
-                    break;
+    /***************************************************************************
+     * @brief   Measures the time taken to draw a number of frames of the given
+     *          pattern, including the conversion to duty cycles, without
+     *          writing them to the outputs. The lead point is spread evenly over
+     *          one revolution across the frames.
+     *
+     * @param   pattern     The pattern index to measure
+     * @param   frames      The number of frames to draw
+     *
+     * @return  The total time taken in microseconds.
+     */
+    unsigned long benchmarkPattern(const int pattern, const unsigned int frames)
+    {
+        const PatternKernel kernel = getPatternRender(pattern);
+        const PatternKernel hook = getPatternSelectHook(pattern);
+        // Converted into a scratch frame, as the back buffer is the one that
+        // the pending frame is compared against when it is committed. It is
+        // volatile so that the unread conversion is not optimised away.
+        volatile byte frame[LED_COUNT];
+        PatternContext bench = context;
+        bench.revolution = 0;
+        if (hook != nullptr)
+        {
+            hook(bench);
+        }
+        const unsigned long startUs = micros();
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            bench.phase = ((unsigned long)f << 16) / frames;
+            bench.angle = ((unsigned long)bench.phase * 360) >> 16;
+            kernel(bench);
+            for (int i = 0; i < LED_COUNT; ++i)
+            {
+                frame[i] = dutyCycles[ledLevels[i]];
+            }
+        }
+        const unsigned long elapsedUs = micros() - startUs;
+        (void)frame;
+        // The pattern state may have been disturbed, so start it afresh
+        selectPattern();
+        return elapsedUs;
+    }
 
-                case Patterns::Throb2:
-                    method = &LedCluster::throbMode2;
-                    break;
+    /***************************************************************************
+     * @brief   Measures the time taken to draw a number of frames of a
+     *          crossfade between two patterns, half way through, including the
+     *          conversion to duty cycles, without writing them to the outputs.
+     *          This is the most work done for any frame. Any crossfade in
+     *          progress is finished.
+     *
+     * @param   from        The pattern index being faded out
+     * @param   to          The pattern index being faded in
+     * @param   frames      The number of frames to draw
+     *
+     * @return  The total time taken in microseconds.
+     */
+    unsigned long benchmarkTransition(
+        const int from,
+        const int to,
+        const unsigned int frames
+    )
+    {
+        // Converted into a scratch frame, as the back buffer is the one that
+        // the pending frame is compared against when it is committed. It is
+        // volatile so that the unread conversion is not optimised away.
+        volatile byte frame[LED_COUNT];
+        PatternContext bench = context;
+        bench.revolution = 0;
+        startPattern(to, bench);
+        transitioning = false;
+        startPattern(from, outgoingContext);
+        const unsigned long startUs = micros();
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            bench.phase = ((unsigned long)f << 16) / frames;
+            bench.angle = ((unsigned long)bench.phase * 360) >> 16;
+            outgoingContext.phase = bench.phase;
+            outgoingContext.angle = bench.angle;
+            drawPattern(to, bench, false);
+            drawPattern(from, outgoingContext, false);
+            crossfadeLevels(bench, outgoingLevels, 128);
+            for (int i = 0; i < LED_COUNT; ++i)
+            {
+                frame[i] = dutyCycles[ledLevels[i]];
+            }
+        }
+        const unsigned long elapsedUs = micros() - startUs;
+        (void)frame;
+        selectPattern();
+        return elapsedUs;
+    }
 
-                case Patterns::Heartbeat:
-                    method = &LedCluster::heartbeatMode;
-                    break;
+    /***************************************************************************
+     * @brief   Measures the time taken to draw a number of frames of a pattern
+     *          layer and blend it with the levels beneath, without the main
+     *          pattern or writing to the outputs. This is the cost of each
+     *          layer added. The layer state is started afresh afterwards.
+     *
+     * @param   pattern     The pattern index drawn by the layer
+     * @param   blend       The BlendMode used
+     * @param   frames      The number of frames to draw
+     *
+     * @return  The total time taken in microseconds.
+     */
+    unsigned long benchmarkLayer(
+        const int pattern,
+        const byte blend,
+        const unsigned int frames
+    )
+    {
+        PatternContext &layer = layerContexts[0];
+        const uint16_t opacity = percentToQ8(LayerConstants::DEFAULT_LAYER_OPACITY);
+        startPattern(pattern, layer);
+        const unsigned long startUs = micros();
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            layer.phase = ((unsigned long)f << 16) / frames;
+            layer.angle = ((unsigned long)layer.phase * 360) >> 16;
+            drawPattern(pattern, layer, false);
+            blendLevels(context, layerLevels, blend, opacity);
+        }
+        const unsigned long elapsedUs = micros() - startUs;
+        startLayer(0);
+        return elapsedUs;
+    }
 
-                case Patterns::Raindrop:
-                    if (lastRevolution != info.revolution)
-                    {
-                        populateRaindrops();
-                    }
-                    method = &LedCluster::raindropMode;
-                    break;
-
-                case Patterns::Flames:
-                    method = &LedCluster::candleMode;
-                    break;
-
-                case Patterns::Static:
-                    method = &LedCluster::staticMode;
-                    break;
-
-                case Patterns::JustOn:
-                    method = &LedCluster::justOn;
-                default:
-                    // No point doing anything, printing to the serial port
-                    // would flood it.
-                    break;
+    /***************************************************************************
+     * @brief   Measures the time taken to draw a number of frames of a particle
+     *          pattern with the particle pool full, including the conversion
+     *          to duty cycles, without writing them to the outputs. The lead
+     *          point is held still so the particles do not expire.
+     *
+     * @param   pattern     The pattern index to measure, which should be a
+     *                      particle pattern
+     * @param   frames      The number of frames to draw
+     *
+     * @return  The total time taken in microseconds.
+     */
+    unsigned long benchmarkParticles(const int pattern, const unsigned int frames)
+    {
+        const PatternKernel kernel = getPatternRender(pattern);
+        // Converted into a scratch frame, as the back buffer is the one that
+        // the pending frame is compared against when it is committed. It is
+        // volatile so that the unread conversion is not optimised away.
+        volatile byte frame[LED_COUNT];
+        PatternContext bench = context;
+        startPattern(pattern, bench);
+#if defined(PATTERN_PARTICLES)
+        primeParticles(bench);
+#endif // PATTERN_PARTICLES
+        kernel(bench);
+        const unsigned long startUs = micros();
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            kernel(bench);
+            for (int i = 0; i < LED_COUNT; ++i)
+            {
+                frame[i] = dutyCycles[ledLevels[i]];
             }
-            if (method != nullptr)
+        }
+        const unsigned long elapsedUs = micros() - startUs;
+        (void)frame;
+        selectPattern();
+        return elapsedUs;
+    }
+
+    /***************************************************************************
+     * @brief   Draws the frames of a pattern in a repeatable way, for comparing
+     *          the output of one build against another. The frames are evenly
+     *          spaced over each revolution, so do not depend on the speed or
+     *          timing, and are drawn at full brightness and the default
+     *          particle density, with the random number generator seeded as
+     *          given. Nothing is written to the outputs. The LED levels and
+     *          extras, the particles and the random number generator are
+     *          restored afterwards, so the running pattern carries on from
+     *          where it was, and the time spent tracing is not counted as
+     *          movement.
+     *
+     * @param   pattern             The pattern index to trace
+     * @param   seed                The random number generator seed
+     * @param   frames              The number of frames to draw
+     * @param   framesPerRevolution The number of frames per revolution
+     * @param   handler             The function given each frame
+     */
+    void tracePattern(
+        const int pattern,
+        const uint16_t seed,
+        const unsigned int frames,
+        const unsigned int framesPerRevolution,
+        const TraceHandler handler
+    )
+    {
+        const unsigned long startMs = millis();
+        const FastRandom savedRng = rng;
+        int savedExtras[LED_COUNT];
+        byte savedLevels[LED_COUNT];
+        memcpy(savedExtras, ledExtras, sizeof(savedExtras));
+        memcpy(savedLevels, ledLevels, sizeof(savedLevels));
+#if defined(PATTERN_PARTICLES)
+        const ParticlePool savedParticles = particlePools[MAIN_POOL];
+#endif // PATTERN_PARTICLES
+        byte duty[LED_COUNT];
+        PatternContext trace = context;
+        trace.angle = 0;
+        trace.phase = 0;
+        trace.revolution = 0;
+        trace.density = DensityConstants::DEFAULT_DENSITY;
+        rng.setSeed(seed);
+        startPattern(pattern, trace);
+        for (unsigned int f = 0; f < frames; ++f)
+        {
+            const long revolution = f / framesPerRevolution;
+            const bool newRevolution = revolution != trace.revolution;
+            trace.revolution = revolution;
+            trace.phase = ((unsigned long)(f % framesPerRevolution) << 16) / framesPerRevolution;
+            trace.angle = ((unsigned long)trace.phase * 360) >> 16;
+            drawPattern(pattern, trace, newRevolution);
+            for (int i = 0; i < LED_COUNT; ++i)
             {
-                for (int i = 0; i < count; ++i)
-                {
-                    (this->*method)(&leds[i], &info);
-                }
-                updateLedBrightnesses();
+                duty[i] = BRIGHTNESS_TO_DUTY_CYCLE[ledLevels[i]];
             }
-            lastRevolution = info.revolution;
+            handler(pattern, f, duty, LED_COUNT);
         }
+        rng = savedRng;
+        memcpy(ledExtras, savedExtras, sizeof(ledExtras));
+        memcpy(ledLevels, savedLevels, sizeof(ledLevels));
+#if defined(PATTERN_PARTICLES)
+        particlePools[MAIN_POOL] = savedParticles;
+#endif // PATTERN_PARTICLES
+        lastPhaseUpdateMs += millis() - startMs;
+    }
+
+    /***************************************************************************
+     * @brief   Gets the number of LEDs within this cluster.
+     *
+     * @return  The number of LEDs.
+     */
+    int getLedCount() const
+    {
+        return LED_COUNT;
     }
 
     /***************************************************************************
@@ -410,7 +1080,7 @@ public:
      */
     int setBrightness(const int value)
     {
-        settings = settingsNV;
+        Settings settings = settingsNV;
         const int newValue = forceRange(
             value,
             BrightnessConstants::MIN_BRIGHTNESS,
@@ -421,6 +1091,7 @@ public:
         {
             settings.brightnessMultiplier = newValue;
             settingsNV = settings;
+            updateDutyCycles();
         }
         return settings.brightnessMultiplier;
     }
@@ -435,8 +1106,7 @@ public:
      */
     int updateBrightness(const int delta)
     {
-        settings = settingsNV;
-        return setBrightness(settings.brightnessMultiplier + delta);
+        return setBrightness(settingsNV->brightnessMultiplier + delta);
     }
 
     /***************************************************************************
@@ -448,13 +1118,15 @@ public:
      */
     int setPattern(const int pattern)
     {
-        settings = settingsNV;
-        const int newValue = forceRange(pattern, 0, Patterns::PATTERN_COUNT);
+        Settings settings = settingsNV;
+        const int newValue = forceRange(pattern, 0, Patterns::PATTERN_COUNT - 1);
         const bool change = settings.pattern != newValue;
         if (change)
         {
-            settings.pattern = newValue;
+            startTransition(settings.pattern);
+            settings.pattern = (Patterns)newValue;
             settingsNV = settings;
+            selectPattern();
         }
         return settings.pattern;
     }
@@ -469,8 +1141,7 @@ public:
      */
     int updatePattern(const int delta)
     {
-        settings = settingsNV;
-        const int pattern = (settings.pattern + Patterns::PATTERN_COUNT + delta) % Patterns::PATTERN_COUNT;
+        const int pattern = (settingsNV->pattern + Patterns::PATTERN_COUNT + delta) % Patterns::PATTERN_COUNT;
         return setPattern(pattern);
     }
 
@@ -484,8 +1155,7 @@ public:
      */
     int updateSpeed(const int delta)
     {
-        settings = settingsNV;
-        return setSpeed(settings.revsPerMinute + (delta * SpeedConstants::SPEED_STEP));
+        return setSpeed(settingsNV->revsPerMinute + (delta * SpeedConstants::SPEED_STEP));
     }
 
     /***************************************************************************
@@ -523,7 +1193,7 @@ public:
      */
     int setSpeed(const int speed)
     {
-        settings = settingsNV;
+        Settings settings = settingsNV;
         const int newValue = forceRange(
             speed,
             SpeedConstants::MIN_SPEED,
@@ -534,12 +1204,164 @@ public:
         {
             settings.revsPerMinute = newValue;
             settingsNV = settings;
-            revTimePeriodMs = ((1000.0f * 60.0f) / settings.revsPerMinute);
+            updatePhaseIncrement();
         }
         return settings.revsPerMinute;
     }
 
 
+    /***************************************************************************
+     * @brief   Sets the time taken to crossfade from one pattern to the next.
+     *
+     * @param   durationMs  The transition time in milliseconds, where zero
+     *                      cuts straight to the next pattern
+     *
+     * @return  The transition time saved.
+     */
+    int setTransitionTime(const int durationMs)
+    {
+        Settings settings = settingsNV;
+        const int newValue = forceRange(
+            durationMs,
+            TransitionConstants::MIN_TRANSITION_MS,
+            TransitionConstants::MAX_TRANSITION_MS
+        );
+        const bool change = newValue != settings.transitionMs;
+        if (change)
+        {
+            settings.transitionMs = newValue;
+            settingsNV = settings;
+        }
+        return settings.transitionMs;
+    }
+
+    /***************************************************************************
+     * @brief   Updates the transition time by incrementing or decrementing by
+     *          the given amount, multiplied by the transition step change.
+     *
+     * @param   delta  The number of steps to be added to the transition time
+     *
+     * @return  The updated transition time in milliseconds.
+     */
+    int updateTransitionTime(const int delta)
+    {
+        return setTransitionTime(
+            settingsNV->transitionMs + (delta * TransitionConstants::TRANSITION_STEP_MS)
+        );
+    }
+
+    /***************************************************************************
+     * @brief   Sets the density of the particle patterns.
+     *
+     * @param   percent     The density as a percentage, where zero spawns no
+     *                      new particles
+     *
+     * @return  The density saved.
+     */
+    int setDensity(const int percent)
+    {
+        Settings settings = settingsNV;
+        const int newValue = forceRange(
+            percent,
+            DensityConstants::MIN_DENSITY,
+            DensityConstants::MAX_DENSITY
+        );
+        const bool change = newValue != settings.particleDensity;
+        if (change)
+        {
+            settings.particleDensity = newValue;
+            settingsNV = settings;
+            updateDensity();
+        }
+        return settings.particleDensity;
+    }
+
+    /***************************************************************************
+     * @brief   Updates the density of the particle patterns by incrementing or
+     *          decrementing by the given amount, multiplied by the density
+     *          step change.
+     *
+     * @param   delta  The number of steps to be added to the density
+     *
+     * @return  The updated density.
+     */
+    int updateDensity(const int delta)
+    {
+        return setDensity(
+            settingsNV->particleDensity + (delta * DensityConstants::DENSITY_STEP)
+        );
+    }
+
+    /***************************************************************************
+     * @brief   Sets up a pattern layer, drawn over the main pattern. The
+     *          opacity and speed are brought within range.
+     *
+     * @param   index   The layer index, from 0 to MAX_LAYERS - 1
+     * @param   layer   The layer settings, with a blend mode of BLEND_OFF to
+     *                  turn the layer off
+     *
+     * @return  True if the layer was set, false if the layer index, pattern or
+     *          blend mode is not valid.
+     */
+    bool setLayer(const int index, const LayerSettings &layer)
+    {
+        const bool valid =
+            (index >= 0) && (index < LayerConstants::MAX_LAYERS) &&
+            (layer.pattern < Patterns::PATTERN_COUNT) &&
+            (layer.blend < BlendMode::BLEND_MODE_COUNT);
+        if (valid)
+        {
+            Settings settings = settingsNV;
+            LayerSettings &saved = settings.layers[index];
+            saved.pattern = layer.pattern;
+            saved.blend = layer.blend;
+            saved.opacity = min(layer.opacity, (byte)100);
+            saved.revsPerMinute = forceRange(
+                layer.revsPerMinute,
+                SpeedConstants::MIN_SPEED,
+                SpeedConstants::MAX_SPEED
+            );
+            settingsNV = settings;
+            startLayer(index);
+        }
+        return valid;
+    }
+
+    /***************************************************************************
+     * @brief   Gets the settings of a pattern layer.
+     *
+     * @param   index   The layer index, which must be valid
+     * @param   layer   The LayerSettings pointer to populate
+     */
+    void getLayer(const int index, LayerSettings * const layer) const
+    {
+        *layer = settingsNV->layers[index];
+    }
+
+    /***************************************************************************
+     * @brief   Seeds the random number generator used by the random patterns,
+     *          and restarts the patterns from the beginning, so that the same
+     *          seed reproduces the same pattern.
+     *
+     * @param   seed    The seed
+     */
+    void setRandomSeed(const uint16_t seed)
+    {
+        randomSeed = seed;
+        rng.setSeed(seed);
+        restartPatterns();
+    }
+
+    /***************************************************************************
+     * @brief   Gets the seed last given to the random number generator.
+     *
+     * @return  The seed.
+     */
+    uint16_t getRandomSeed() const
+    {
+        return randomSeed;
+    }
+
     /***************************************************************************
      * @brief   Starts the illumination pattern when not in the running state.
      */
@@ -547,246 +1369,435 @@ public:
     {
         if (!running)
         {
-            startTimeMs = millis();
+            restartPatterns();
             running = true;
+            // Draw the first frame straight away
+            frameDue = true;
+            lastPoll = millis() - MIN_SETTLE_TIME;
+            resetFrameStats();
             poll();
         }
     }
 
     /***************************************************************************
-     * @brief   Stops running mode, and turns off the LEDs.
+     * @brief   Stops running mode, and turns off the LEDs. Any pending settings
+     *          changes are committed, as the unit may be powered off once
+     *          asleep.
      */
     void shutdown()
     {
         running = false;
-        for (int i = 0; i < count; ++i)
+        settingsNV.flush();
+        // Drop any frame waiting to be committed, and turn the LEDs off now.
+        // Both buffers are cleared to match, so the next frame is compared
+        // against what the outputs are actually showing.
+        noInterrupts();
+        pendingFrame = nullptr;
+        memset(frameBuffers, 0, sizeof(frameBuffers));
+        const bool unrolled[] = { (writeOutput<LedPins>(0), true)... };
+        (void)unrolled;
+        interrupts();
+    }
+
+    /***************************************************************************
+     * @brief   Commits the frame waiting in the front buffer to the PWM
+     *          outputs. This is to be called only from the frame tick
+     *          interrupt, just after timer 2 overflows. The compare registers
+     *          are double buffered by the hardware, so the timer 2 outputs
+     *          change together at the start of its next PWM period. Timers 0
+     *          and 1 are not phase-locked to timer 2, so their outputs change
+     *          at the start of their own next period, only close to it.
+     */
+    void commitPendingFrame()
+    {
+        const byte * const frame = pendingFrame;
+        if (frame != nullptr)
         {
-            analogWrite(leds[i].pin, 0);
+            // The other buffer holds the frame committed last time, so only
+            // the outputs that differ from it need writing
+            const byte * const previous =
+                (frame == frameBuffers) ? frameBuffers + LED_COUNT : frameBuffers;
+            byte index = 0;
+            const bool unrolled[] = {
+                (writeChangedOutput<LedPins>(frame, previous, index++), true)...
+            };
+            (void)unrolled;
+            pendingFrame = nullptr;
         }
     }
 
-private:
-
     /***************************************************************************
-     * @brief   Populates the values required for the raindrop illumination
-     *          pattern.
+     * @brief   Gets the average number of PWM output writes per second made
+     *          while the given pattern has been running.
+     *
+     * @param   pattern     The pattern to get the write rate of
+     *
+     * @return  The writes per second, or zero if the pattern has not run.
      */
-    void populateRaindrops()
+    unsigned long getWritesPerSecond(const int pattern) const
     {
-        for(int i = 0; i < count; i++)
+        const PatternOutputStats &stats = outputStats[pattern];
+        if (stats.timeMs == 0)
+        {
+            return 0;
+        }
+        // Scaling the writes up by 1000 would overflow after a few hours, by
+        // which time whole seconds are close enough to scale the time down
+        if (stats.writes <= ULONG_MAX / 1000)
         {
-            leds[i].extra = random(360 - RaindropConstants::RAINDROP_ANGLE);
+            return (stats.writes * 1000) / stats.timeMs;
         }
+        return stats.writes / (stats.timeMs / 1000);
     }
 
     /***************************************************************************
-     * @brief   Gets the light information for where the "lead" point around
-     *          the circle is, and how many revolutions have occurred. This is
-     *          based on the current speed.
+     * @brief   Gets the statistics on the interval between frames.
      *
-     * @param   info    The LightLocationInfo pointer to populate
+     * @param   stats   The FrameStats pointer to populate
      */
-    void getCurrentLightInfo(LightLocationInfo * const info)
+    void getFrameStats(FrameStats * const stats) const
     {
+        *stats = frameStats;
+    }
 
-        // Get the elapsed time since the start of the sequences
-        long elapsedMs = (millis() - startTimeMs);
-        info->angle = (360.0f * (elapsedMs % (long)revTimePeriodMs)) / revTimePeriodMs;
-        info->revolution = elapsedMs / (long)revTimePeriodMs;
+    /***************************************************************************
+     * @brief   Clears the statistics on the interval between frames.
+     */
+    void resetFrameStats()
+    {
+        frameStats.minUs = 0xFFFFFFFF;
+        frameStats.maxUs = 0;
+        frameStats.totalUs = 0;
+        frameStats.count = 0;
+        lastFrameUs = micros();
     }
 
     /***************************************************************************
-     * @brief   Lights are simply on at the global brightness
+     * @brief   Sets the time the settings must remain unchanged before they are
+     *          committed to EEPROM.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @param   delayMs  The commit delay in milliseconds
      */
-    void justOn(LedInfo * const led, const LightLocationInfo *const info)
+    void setSettingsCommitDelay(const unsigned long delayMs)
     {
-        led->brightness = globaliseBrightness(100);
+        settingsNV.setCommitDelay(delayMs);
     }
 
     /***************************************************************************
-     * @brief   Chase mode (anti-clockwise).
-     *          Chasing - The lead LED comes on at full brightness, and dims as
-     *          the head of the circle moves around.
+     * @brief   Gets the number of EEPROM bytes written when saving settings.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @return  The number of bytes written.
      */
-    void chaseModeAcw(LedInfo * const led, const LightLocationInfo *const info)
+    unsigned long getSettingsWriteCount() const
     {
-        const int angle = (int)((info->angle + 360.0f) + led->angle) % 360;
-        led->brightness = globaliseBrightness(round((100.0f * (360 - angle)) / 360.0f));
+        return settingsNV.getWriteCount();
     }
 
     /***************************************************************************
-     * @brief   Chase mode (clockwise).
-     *          Chasing - The lead LED comes on at full brightness, and dims as
-     *          the head of the circle moves around.
+     * @brief   Gets the number of EEPROM byte writes avoided when saving
+     *          settings, through coalescing changes and skipping bytes that
+     *          were unchanged.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @return  The number of byte writes avoided.
      */
-    void chaseModeCw(LedInfo * const led, const LightLocationInfo *const info)
+    unsigned long getSettingsWritesAvoided() const
     {
-        const int angle = (int)((info->angle + 360.0f) - led->angle) % 360;
-        led->brightness = globaliseBrightness(round((100.0f * (360 - angle)) / 360.0f));
+        return settingsNV.getAvoidedWriteCount();
     }
 
+private:
+
+#if defined(TIMSK2)
     /***************************************************************************
-     * @brief   Chase mode (both).
-     *          Chasing - The lead LED comes on at full brightness, and dims as
-     *          the head of the circle moves around. With this case, the head of
-     *          the circle is mirrored at 180 degrees.
-     *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @brief   Frame tick handler, committing the pending frame of the cluster
+     *          driven by the frame tick.
      */
-    void chaseModeBoth(LedInfo * const led, const LightLocationInfo *const info)
+    static void commitTickedFrame()
     {
-        const int angle = min(
-            (int)((info->angle + 360.0f) - led->angle) % 360,
-            (int)((info->angle + 360.0f) + led->angle) % 360
-        );
-        led->brightness = globaliseBrightness(round((100.0f * (360 - angle)) / 360.0f));
+        tickCluster->commitPendingFrame();
     }
+#endif // TIMSK2
 
     /***************************************************************************
-     * @brief   Raindrop mode.
-     *          Each light randomly lights up quickly then fades once per
-     *          revolution.
+     * @brief   Prepares the current pattern to be drawn, by calling its select
+     *          hook if it has one.
+     */
+    void selectPattern()
+    {
+        startPattern(settingsNV->pattern, context);
+    }
+
+    /***************************************************************************
+     * @brief   Prepares a pattern to be drawn into the given context, by
+     *          calling its select hook if it has one.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @param   pattern     The pattern index
+     * @param   target      The pattern context the pattern is drawn into
      */
-    void raindropMode(LedInfo * const led, const LightLocationInfo *const info)
+    static void startPattern(const int pattern, const PatternContext &target)
     {
-        const int position = info->angle - led->extra;
-        if (position >= 0 && position < RaindropConstants::RAMPUP_ANGLE)
+        const PatternKernel hook = getPatternSelectHook(pattern);
+        if (hook != nullptr)
         {
-            // Ramp up
-            led->brightness = globaliseBrightness(
-                round((100.0f * position) / RaindropConstants::RAMPUP_ANGLE)
-            );
+            hook(target);
+        }
+    }
 
+    /***************************************************************************
+     * @brief   Draws a frame of a pattern into the given context.
+     *
+     * @param   pattern         The pattern index
+     * @param   target          The pattern context to draw into
+     * @param   newRevolution   Whether this is the first frame of a revolution
+     */
+    static void drawPattern(
+        const int pattern,
+        const PatternContext &target,
+        const bool newRevolution
+    )
+    {
+        if (newRevolution)
+        {
+            const PatternKernel hook = getPatternRevolutionHook(pattern);
+            if (hook != nullptr)
+            {
+                hook(target);
+            }
         }
-        else if ((position >= RaindropConstants::RAMPUP_ANGLE) &&
-                (position < RaindropConstants::RAINDROP_ANGLE))
+        getPatternRender(pattern)(target);
+    }
+
+    /***************************************************************************
+     * @brief   Starts crossfading out of the current pattern, which carries on
+     *          being drawn from its present state. Nothing is faded whilst
+     *          asleep, or if the transition time is zero. If a crossfade is
+     *          already under way, the last frame of it is held and faded out
+     *          instead, so the display carries on from the blend it showed. If
+     *          no frame of it has been drawn yet, what was being faded out
+     *          carries on being faded out.
+     *
+     * @param   pattern     The pattern being faded out
+     */
+    void startTransition(const Patterns pattern)
+    {
+        const bool interrupted = transitioning;
+        transitioning = running && (settingsNV->transitionMs > 0);
+        if (transitioning)
         {
-            /// Ramp down
-            led->brightness = globaliseBrightness(100 -
-                round((100.0f * (position - RaindropConstants::RAMPUP_ANGLE)) /
-                    RaindropConstants::RAMPDOWN_ANGLE)
-            );
+            if (interrupted && crossfadeDrawn)
+            {
+                outgoingFrozen = true;
+                memcpy(outgoingLevels, crossfadedLevels, sizeof(outgoingLevels));
+            }
+            else if (!interrupted)
+            {
+                outgoingFrozen = false;
+                outgoingPattern = pattern;
+                memcpy(outgoingExtras, ledExtras, sizeof(outgoingExtras));
+#if defined(PATTERN_PARTICLES)
+                particlePools[OUTGOING_POOL] = particlePools[MAIN_POOL];
+#endif // PATTERN_PARTICLES
+            }
+            crossfadeDrawn = false;
+            transitionStartMs = millis();
         }
-        else
+    }
+
+    /***************************************************************************
+     * @brief   Moves the main pattern and the pattern layers back to the start
+     *          of their first revolution. The pattern contexts are moved back
+     *          too, so that a pattern started afterwards measures its first
+     *          frame from the start rather than from where it was.
+     */
+    void resetClocks()
+    {
+        lastPhaseUpdateMs = millis();
+        resetClock(clock);
+        resetPosition(context);
+        resetPosition(outgoingContext);
+        for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
         {
-            led->brightness = 0;
+            resetClock(layerClocks[l]);
+            resetPosition(layerContexts[l]);
         }
     }
 
     /***************************************************************************
-     * @brief   Candle (flame) mode.
-     *          Rough attempt at a candle flicker. Currently this works well
-     *          enough, though takes a little while to settle, and it's far from
-     *          realistic.
+     * @brief   Moves a pattern context back to the start of the first
+     *          revolution.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @param   target  The pattern context to reset
      */
-    void candleMode(LedInfo * const led, const LightLocationInfo *const info)
+    static void resetPosition(PatternContext &target)
     {
-        led->extra = forceRange(led->extra + random(-4, 4), 0, 100);
-        led->brightness = globaliseBrightness(led->extra);
+        target.angle = 0;
+        target.phase = 0;
+        target.revolution = 0;
     }
 
     /***************************************************************************
-     * @brief   Static noise mode.
-     *          Fairly random flickering. This is based on candle mode, but with
-     *          some additional spikes of noise added.
-     *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @brief   Restarts the main pattern and the pattern layers from the start
+     *          of their first revolution, dropping any crossfade under way.
      */
-    void staticMode(LedInfo * const led, const LightLocationInfo *const info)
+    void restartPatterns()
     {
-        candleMode(led, info);
-        const int noise = random(-10, 40);
-        led->brightness = globaliseBrightness(forceRange(led->extra + noise, 0, 100));
+        resetClocks();
+        transitioning = false;
+        selectPattern();
+        for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
+        {
+            startLayer(l);
+        }
     }
 
     /***************************************************************************
-     * @brief   Wave mode (clockwise)
-     *          The peak of the circle is brightest, with the area surrounding
-     *          it dimming gently to nothing at 180 degrees away.
+     * @brief   Gets one of the particle pools.
+     *
+     * @param   index   The ParticlePools index
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @return  The particle pool, or null if the particle patterns are not
+     *          built in.
      */
-    void waveModeCw(LedInfo *const led, const LightLocationInfo * const info)
+    ParticlePool *getParticlePool(const int index)
     {
-        int angle = (int)(info->angle - led->angle);
-        angle = abs(((angle + 180) % 360) - 180);
-        led->brightness = globaliseBrightness(round((100.0f * (180 - angle)) / 180.0f));
+#if defined(PATTERN_PARTICLES)
+        return &particlePools[index];
+#else
+        (void)index;
+        return nullptr;
+#endif // PATTERN_PARTICLES
+    }
+
+    /***************************************************************************
+     * @brief   Passes the particle density setting on to every pattern
+     *          context.
+     */
+    void updateDensity()
+    {
+        const byte density = settingsNV->particleDensity;
+        context.density = density;
+        outgoingContext.density = density;
+        for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
+        {
+            layerContexts[l].density = density;
+        }
     }
 
     /***************************************************************************
-     * @brief   Wave mode (anti-clockwise)
-     *          The peak of the circle is brightest, with the area surrounding
-     *          it dimming gently to nothing at 180 degrees away.
+     * @brief   Checks the pattern layers within the settings are valid.
+     *
+     * @param   settings    The settings to check
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @return  True if every layer has a valid pattern, blend mode and speed.
      */
-    void waveModeAcw(LedInfo *const led, const LightLocationInfo * const info)
+    static bool layersValid(const Settings &settings)
     {
-        int angle = (int)(info->angle - led->angle);
-        angle = abs((((360 - angle) + 180) % 360) - 180);
-        led->brightness = globaliseBrightness(round((100.0f * (180 - angle)) / 180.0f));
+        bool valid = true;
+        for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
+        {
+            valid = valid &&
+                (settings.layers[l].pattern < Patterns::PATTERN_COUNT) &&
+                (settings.layers[l].blend < BlendMode::BLEND_MODE_COUNT) &&
+                (settings.layers[l].revsPerMinute >= SpeedConstants::MIN_SPEED) &&
+                (settings.layers[l].revsPerMinute <= SpeedConstants::MAX_SPEED);
+        }
+        return valid;
     }
 
     /***************************************************************************
-     * @brief   Throb mode
-     *          The lights all throb from off to on in unison.
+     * @brief   Prepares a pattern layer to be drawn, setting its speed and
+     *          calling the select hook of its pattern.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @param   index   The layer index
      */
-    void throbMode(LedInfo *const led, const LightLocationInfo * const info)
+    void startLayer(const int index)
     {
-        const float RADS_PER_DEGREE = 0.0174533f;
-        led->brightness = globaliseBrightness((1.0f + cos(info->angle * RADS_PER_DEGREE)) * 50.0f);
+        const LayerSettings &layer = settingsNV->layers[index];
+        setClockSpeed(layerClocks[index], layer.revsPerMinute);
+        startPattern(layer.pattern, layerContexts[index]);
     }
 
     /***************************************************************************
-     * @brief   Throb mode
-     *          The lights all throb from off to on in unison.
+     * @brief   Advances each pattern layer that is turned on, draws it and
+     *          blends it over the levels drawn so far, from the bottom layer up.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @param   elapsedMs   The time elapsed since the last frame
      */
-    void throbMode2(LedInfo *const led, const LightLocationInfo * const info)
+    void drawLayers(const unsigned long elapsedMs)
     {
-        const float RADS_PER_DEGREE = 0.0174533f;
-        const int value = 2 * round(abs(180.0f - info->angle));
-        led->brightness = globaliseBrightness((1.0f + sin(value * RADS_PER_DEGREE)) * 50.0f);
+        for (int l = 0; l < LayerConstants::MAX_LAYERS; ++l)
+        {
+            const LayerSettings &layer = settingsNV->layers[l];
+            if (layer.blend != BlendMode::BLEND_OFF)
+            {
+                PatternContext &target = layerContexts[l];
+                const bool newRevolution = advanceClock(layerClocks[l], elapsedMs, target);
+                drawPattern(layer.pattern, target, newRevolution);
+                blendLevels(context, layerLevels, layer.blend, percentToQ8(layer.opacity));
+            }
+        }
     }
 
     /***************************************************************************
-     * @brief   Heartbeat mode.
-     *          Provides two pulses per revolution.
+     * @brief   Checks whether a frame is due, and if so, claims it and records
+     *          the interval since the last frame.
      *
-     * @param   led     The LED to update
-     * @param   info    The current light info, where the lead of the circle is
+     * @return  True if a frame should be drawn, false otherwise.
+     */
+    bool takeFrame()
+    {
+#if defined(TIMSK2)
+        if (!frameDue)
+        {
+            return false;
+        }
+        frameDue = false;
+#else
+        if (millis() - lastPoll < MIN_SETTLE_TIME)
+        {
+            return false;
+        }
+        lastPoll = millis();
+#endif // TIMSK2
+        const unsigned long nowUs = micros();
+        const unsigned long intervalUs = nowUs - lastFrameUs;
+        lastFrameUs = nowUs;
+        frameStats.minUs = min(frameStats.minUs, intervalUs);
+        frameStats.maxUs = max(frameStats.maxUs, intervalUs);
+        frameStats.totalUs += intervalUs;
+        ++frameStats.count;
+        PERF_FRAME_INTERVAL(intervalUs);
+        // Attribute the time to the current pattern, carrying the sub
+        // millisecond remainder over to the next frame
+        patternTimeUs += intervalUs;
+        const unsigned long elapsedMs = patternTimeUs / 1000;
+        patternTimeUs -= elapsedMs * 1000;
+        outputStats[settingsNV->pattern].timeMs += elapsedMs;
+        return true;
+    }
+
+    /***************************************************************************
+     * @brief   Updates the speed of the main pattern clock to match the current
+     *          speed setting.
      */
-    void heartbeatMode(LedInfo *const led, const LightLocationInfo * const info)
+    void updatePhaseIncrement()
     {
-        const int delta = round(min(abs(225.0f - info->angle), abs(135.0f - info->angle)));
-        const int percent = round((100 * delta) / 135.0f);
-        const int value = round(((100 - percent) * 2.0f) - 100.0f);
+        setClockSpeed(clock, settingsNV->revsPerMinute);
+    }
 
-        led->brightness = globaliseBrightness(value);
+    /***************************************************************************
+     * @brief   Gets the time elapsed since the pattern clocks were last
+     *          advanced, using unsigned arithmetic so that the millis()
+     *          rollover does not disturb it.
+     *
+     * @return  The time elapsed in milliseconds.
+     */
+    unsigned long takeElapsedMs()
+    {
+        const unsigned long nowMs = millis();
+        const unsigned long elapsedMs = nowMs - lastPhaseUpdateMs;
+        lastPhaseUpdateMs = nowMs;
+        return elapsedMs;
     }
 
     /***************************************************************************
@@ -799,11 +1810,12 @@ private:
      */
     int globaliseBrightness(int brightness)
     {
-        settings = settingsNV;
-        if (settings.brightnessMultiplier != BrightnessConstants::MAX_BRIGHTNESS)
+        const int multiplier = settingsNV->brightnessMultiplier;
+        if (multiplier != BrightnessConstants::MAX_BRIGHTNESS)
         {
-            brightness = round(
-                (float)(settings.brightnessMultiplier * brightness) /
+            brightness = scaleRounded(
+                brightness,
+                multiplier,
                 BrightnessConstants::MAX_BRIGHTNESS
             );
         }
@@ -811,41 +1823,325 @@ private:
     }
 
     /***************************************************************************
-     * @brief   Writes the current brightness levels to the LEDs within the
-     *          cluster.
+     * @brief   Updates the look up table from brightness levels to duty cycles,
+     *          which applies the global brightness. This only changes with the
+     *          brightness setting, so is not worked out for every LED on every
+     *          frame.
+     */
+    void updateDutyCycles()
+    {
+        for (int level = 0; level <= MAX_BRIGHTNESS_PCT; ++level)
+        {
+            dutyCycles[level] = brightnessToDutyCycle(globaliseBrightness(level));
+        }
+    }
+
+    /***************************************************************************
+     * @brief   Sets a PWM output pin up as an output that is initially off.
+     *
+     * @tparam  Pin     The output pin
+     */
+    template <byte Pin>
+    static void setupOutput()
+    {
+        pinMode(Pin, OUTPUT);
+        digitalWrite(Pin, LOW);
+    }
+
+    /***************************************************************************
+     * @brief   Writes a duty cycle to a PWM output through its timer registers.
+     *          A duty cycle of zero disconnects the pin from the timer, leaving
+     *          it held low, as analogWrite() does.
+     *
+     * @tparam  Register    The type of the output compare register, which is
+     *                      16-bit for timer 1 so that both bytes are written
+     *                      through the high byte buffer, as analogWrite() does
+     * @param   ocr     The output compare register of the timer output
+     * @param   tccr    The timer control register holding the compare output
+     *                  mode bit
+     * @param   comBit  The compare output mode bit, connecting the pin to the
+     *                  timer
+     * @param   duty    The duty cycle, from 0 to 255
+     */
+    template <typename Register>
+    static void writeCompare(
+        volatile Register &ocr,
+        volatile byte &tccr,
+        const byte comBit,
+        const byte duty
+    )
+    {
+        if (duty == 0)
+        {
+            tccr &= ~comBit;
+        }
+        else
+        {
+            ocr = duty;
+            tccr |= comBit;
+        }
+    }
+
+    /***************************************************************************
+     * @brief   Writes a duty cycle to a PWM output. The timer output is known
+     *          at compile time, so this reduces to the register writes for the
+     *          pin, without the look ups carried out by analogWrite().
+     *
+     * @tparam  Pin     The output pin
+     * @param   duty    The duty cycle, from 0 to 255
+     */
+    template <byte Pin>
+    static void writeOutput(const byte duty)
+    {
+#if defined(DIRECT_PWM_OUTPUT)
+        switch (Board::pwmTimer(Pin))
+        {
+            case PWM_TIMER0A:
+                writeCompare(OCR0A, TCCR0A, _BV(COM0A1), duty);
+                break;
+
+            case PWM_TIMER0B:
+                writeCompare(OCR0B, TCCR0A, _BV(COM0B1), duty);
+                break;
+
+            case PWM_TIMER1A:
+                writeCompare(OCR1A, TCCR1A, _BV(COM1A1), duty);
+                break;
+
+            case PWM_TIMER1B:
+                writeCompare(OCR1B, TCCR1A, _BV(COM1B1), duty);
+                break;
+
+            case PWM_TIMER2A:
+                writeCompare(OCR2A, TCCR2A, _BV(COM2A1), duty);
+                break;
+
+            case PWM_TIMER2B:
+                writeCompare(OCR2B, TCCR2A, _BV(COM2B1), duty);
+                break;
+
+            default:
+                analogWrite(Pin, duty);
+                break;
+        }
+#else
+        analogWrite(Pin, duty);
+#endif // DIRECT_PWM_OUTPUT
+    }
+
+    /***************************************************************************
+     * @brief   Writes the duty cycle of an LED to its PWM output, if it differs
+     *          from the previous frame.
+     *
+     * @tparam  Pin         The output pin
+     * @param   frame       The frame being committed
+     * @param   previous    The frame committed last time
+     * @param   index       The index of the LED within the frames
+     */
+    template <byte Pin>
+    static void writeChangedOutput(
+        const byte * const frame,
+        const byte * const previous,
+        const byte index
+    )
+    {
+        if (frame[index] != previous[index])
+        {
+            writeOutput<Pin>(frame[index]);
+        }
+    }
+
+    /***************************************************************************
+     * @brief   Renders the current brightness levels of the LEDs into the back
+     *          frame buffer, then hands it over to be committed to the outputs
+     *          on the next frame tick. The following frame is then rendered
+     *          into the other buffer.
+     *          The front buffer always holds the last frame handed over, so if
+     *          no duty cycle has changed since then the frame is dropped
+     *          rather than committed.
      */
     void updateLedBrightnesses()
     {
-        for (int i = 0; i < count; ++i)
+        byte * const frame = frameBuffers + (backBuffer * LED_COUNT);
+        const byte * const previous = frameBuffers + ((backBuffer ^ 1) * LED_COUNT);
+        int changes = 0;
+        for (int i = 0; i < LED_COUNT; ++i)
+        {
+            frame[i] = dutyCycles[ledLevels[i]];
+            if (frame[i] != previous[i])
+            {
+                ++changes;
+            }
+        }
+        if (changes == 0)
         {
-            analogWrite(leds[i].pin, brightnessToDutyCycle(leds[i].brightness));
+            return;
         }
+        outputStats[settingsNV->pattern].writes += changes;
+#if defined(TIMSK2)
+        noInterrupts();
+        pendingFrame = frame;
+        interrupts();
+#else
+        pendingFrame = frame;
+        commitPendingFrame();
+#endif // TIMSK2
+        backBuffer ^= 1;
     }
 
-    /// @brief  Pointer to the LED information cluster.
-    LedInfo *leds;
+    /// @brief  The position of each LED around the circle as a binary angle.
+    uint16_t ledPhases[LED_COUNT];
 
-    /// @brief  The number of LEDs within this cluster.
-    const int count;
+    /// @brief  Pattern specific state for each LED.
+    int ledExtras[LED_COUNT];
+
+    /// @brief  The brightness level of each LED as a percentage, before the
+    ///         global brightness is applied.
+    byte ledLevels[LED_COUNT];
+
+    /// @brief  The pattern context, giving the pattern kernels the position
+    ///         of the lead point and the LEDs.
+    PatternContext context;
+
+    /// @brief  The pattern specific state of each LED for the pattern being
+    ///         faded out.
+    int outgoingExtras[LED_COUNT];
 
-    /// @brief  The current number of revolutions per minute (speed) of illuminations.
-    float revsPerMinute;
+    /// @brief  The brightness level of each LED for the pattern being faded
+    ///         out.
+    byte outgoingLevels[LED_COUNT];
 
-    /// @brief  The time that this illumination pattern was started.
-    long startTimeMs;
+    /// @brief  The pattern context the pattern being faded out is drawn with.
+    PatternContext outgoingContext;
+
+    /// @brief  The brightness level of each LED in the last frame of the
+    ///         crossfade, before the pattern layers were drawn over it.
+    byte crossfadedLevels[LED_COUNT];
+
+    /// @brief  The position of the lead point of each pattern layer.
+    PatternClock layerClocks[LayerConstants::MAX_LAYERS];
+
+    /// @brief  The pattern specific state of each LED for each pattern layer.
+    int layerExtras[LayerConstants::MAX_LAYERS][LED_COUNT];
+
+    /// @brief  The brightness level of each LED for the pattern layer being
+    ///         drawn. The layers are blended one at a time, so share this.
+    byte layerLevels[LED_COUNT];
+
+    /// @brief  The pattern context each pattern layer is drawn with.
+    PatternContext layerContexts[LayerConstants::MAX_LAYERS];
+
+    /// @brief  The particle pools, one for each pattern context.
+    enum ParticlePools
+    {
+        MAIN_POOL,
+        OUTGOING_POOL,
+        FIRST_LAYER_POOL,
 
-    /// @brief  The number of milliseconds per pattern revolution.
-    long revTimePeriodMs;
+        PARTICLE_POOL_COUNT = FIRST_LAYER_POOL + LayerConstants::MAX_LAYERS
+    };
 
-    /// @brief  Accessor variable to read and write the settings to non-volatile memory.
-    NonVol<Settings> settingsNV;
+#if defined(PATTERN_PARTICLES)
+    /// @brief  The storage for the particle pools.
+    ParticlePool particlePools[PARTICLE_POOL_COUNT];
+#endif // PATTERN_PARTICLES
 
-    /// @brief  The current settings.
-    Settings settings;
+    /// @brief  The duty cycle for each brightness level, with the global
+    ///         brightness applied.
+    byte dutyCycles[MAX_BRIGHTNESS_PCT + 1];
+
+    /// @brief  The front and back frame buffers, holding the duty cycle of
+    ///         each LED.
+    byte frameBuffers[2 * LED_COUNT];
+
+    /// @brief  The index of the frame buffer to render the next frame into.
+    byte backBuffer;
+
+    /// @brief  The frame waiting to be committed to the outputs, if any.
+    const byte * volatile pendingFrame;
+
+    /// @brief  The time the pattern clocks were last advanced.
+    unsigned long lastPhaseUpdateMs;
+
+    /// @brief  The position of the lead point of the main pattern.
+    PatternClock clock;
+
+    /// @brief  Accessor variable to read and write the settings to non-volatile
+    ///         memory. This holds the current settings in SRAM, so reading them
+    ///         does not require an EEPROM access.
+    WearLevelledNonVol<Settings> settingsNV;
 
     /// @brief  Whether the LED cluster is currently running/displaying patterns.
     bool running;
 
     /// @brief  Keep track of the last poll, as the PWM values need a certain time to settle.
     long lastPoll;
+
+    /// @brief  The time of the last frame in microseconds.
+    unsigned long lastFrameUs;
+
+    /// @brief  Statistics on the interval between frames.
+    FrameStats frameStats;
+
+    /// @brief  Time not yet attributed to a pattern, in microseconds.
+    unsigned long patternTimeUs;
+
+    /// @brief  The number of PWM output writes made, and the time spent, by
+    ///         each pattern.
+    PatternOutputStats outputStats[Patterns::PATTERN_COUNT];
+
+    /// @brief  Whether a crossfade from one pattern to the next is under way.
+    bool transitioning;
+
+    /// @brief  The pattern being faded out.
+    Patterns outgoingPattern;
+
+    /// @brief  Whether the frame being faded out is held still, rather than
+    ///         the outgoing pattern being drawn, as when the pattern was
+    ///         changed part way through a crossfade.
+    bool outgoingFrozen;
+
+    /// @brief  Whether a frame of the crossfade has been drawn since it
+    ///         started, so that crossfadedLevels holds it.
+    bool crossfadeDrawn;
+
+    /// @brief  The time the crossfade started in milliseconds.
+    unsigned long transitionStartMs;
+
+    /// @brief  The random number generator used by the random patterns.
+    FastRandom rng;
+
+    /// @brief  The seed last given to the random number generator.
+    uint16_t randomSeed;
+
+#if defined(TIMSK2)
+    /// @brief  The cluster whose frames are committed by the frame tick.
+    static LedCluster *tickCluster;
+#endif // TIMSK2
 };
+
+#if defined(TIMSK2)
+template <typename Board, byte... LedPins>
+LedCluster<Board, LedPins...> *LedCluster<Board, LedPins...>::tickCluster = nullptr;
+#endif // TIMSK2
+
+#if defined(TIMSK2)
+/*******************************************************************************
+ * @brief   Timer 2 overflow interrupt, used as the fixed rate frame tick. The
+ *          timer continues to provide PWM on pins 3 and 11 as normal. Each
+ *          tick commits the frame rendered since the last one, and flags that
+ *          the next frame is due to be rendered.
+ */
+ISR(TIMER2_OVF_vect)
+{
+    if (++frameTicks >= FRAME_TICKS)
+    {
+        frameTicks = 0;
+        if (frameTickHandler != nullptr)
+        {
+            frameTickHandler();
+        }
+        frameDue = true;
+    }
+}
+#endif // TIMSK2
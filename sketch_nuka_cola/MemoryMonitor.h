@@ -0,0 +1,147 @@
+/**
+ * @file    MemoryMonitor.h
+ *
+ * @brief   Provides SRAM usage monitoring. At boot, before any constructors
+ *          run, all of the SRAM between the end of the static data and the
+ *          stack is painted with a known value. Any byte that no longer holds
+ *          that value has been used by either the heap (growing up) or the
+ *          stack (growing down), so the painted bytes left in between give the
+ *          smallest gap there has ever been between the two.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+#include "NoHeap.h"
+
+/// @brief  The value free SRAM is painted with at boot.
+static const byte MEMORY_PAINT = 0xC5;
+
+/// @brief  The number of consecutive painted bytes that mark the end of the
+///         heap. Allocated heap memory may contain the odd byte that happens
+///         to match the paint, but it is unlikely to contain a run of them.
+static const byte MEMORY_PAINT_RUN = 8;
+
+/// @brief  The smallest gap in bytes between the heap and the stack that is
+///         considered safe. Reports flag when the gap has fallen below this.
+static const int MEMORY_SAFETY_MARGIN = 128;
+
+/// @brief  The SRAM high water marks since boot, in bytes.
+struct MemoryWatermarks
+{
+    // The most heap that has been in use
+    int heapPeak;
+    // The most stack that has been in use
+    int stackPeak;
+    // The smallest gap there has been between the heap and the stack
+    int minGap;
+};
+
+/*******************************************************************************
+ * @brief   Paints a range of memory with MEMORY_PAINT. This is always inlined,
+ *          so the naked boot code that paints the free SRAM makes no calls.
+ *
+ * @param   start   The first byte to paint
+ * @param   end     The byte after the last to paint
+ */
+static inline __attribute__((always_inline)) void paintMemory(byte *start, const byte * const end)
+{
+    while (start < end)
+    {
+        *start++ = MEMORY_PAINT;
+    }
+}
+
+/*******************************************************************************
+ * @brief   Gets the high water marks of a painted range of memory, with the
+ *          heap growing up from its start and the stack down from its end.
+ *
+ * @param   start   The first byte of the range, the bottom of the heap
+ * @param   end     The byte after the last of the range, the top of the stack
+ * @param   marks   The MemoryWatermarks pointer to populate
+ */
+static inline void scanMemoryWatermarks(
+    const byte * const start,
+    const byte * const end,
+    MemoryWatermarks * const marks
+)
+{
+    const byte *address = start;
+    // Find the end of the heap, the first run of painted bytes
+    byte run = 0;
+    while (address < end && run < MEMORY_PAINT_RUN)
+    {
+        run = (*address++ == MEMORY_PAINT) ? run + 1 : 0;
+    }
+    const byte * const heapEnd = address - run;
+    // Then the bottom of the stack, the first byte after that not painted
+    while (address < end && *address == MEMORY_PAINT)
+    {
+        ++address;
+    }
+    marks->heapPeak = heapEnd - start;
+    marks->stackPeak = end - address;
+    marks->minGap = address - heapEnd;
+}
+
+#if defined(__AVR__)
+extern byte __heap_start;
+#if !defined(NO_HEAP)
+/// @brief  The top of the heap, maintained by malloc(). This is defined by the
+///         same object as malloc() in avr-libc, so it is not referenced when
+///         the heap is disabled, as it would pull that object into the link.
+extern byte *__brkval;
+#endif // NO_HEAP
+
+/*******************************************************************************
+ * @brief   Paints the free SRAM. This is placed in the .init3 section, so it
+ *          runs automatically at boot after the stack pointer is set up and
+ *          before the static data is initialised or any constructors run. It
+ *          must not be called directly.
+ */
+void paintFreeMemory() __attribute__((naked, used, section(".init3")));
+void paintFreeMemory()
+{
+    paintMemory(&__heap_start, (byte *)SP);
+}
+#endif // __AVR__
+
+/*******************************************************************************
+ * @brief   Gets the amount of free SRAM, between the top of the heap and the
+ *          bottom of the stack.
+ *
+ * @return  The number of free bytes, or zero if unknown on this platform.
+ */
+static inline int freeMemory()
+{
+#if defined(__AVR__)
+    byte stackTop;
+#if defined(NO_HEAP)
+    // Nothing can be allocated, so the heap is always empty
+    const byte * const heapTop = &__heap_start;
+#else
+    const byte * const heapTop = (__brkval == nullptr) ? &__heap_start : __brkval;
+#endif // NO_HEAP
+    return &stackTop - heapTop;
+#else
+    return 0;
+#endif // __AVR__
+}
+
+/*******************************************************************************
+ * @brief   Gets the SRAM high water marks since boot, by scanning for the
+ *          painted bytes left between the heap and the stack.
+ *
+ * @param   marks   The MemoryWatermarks pointer to populate
+ */
+static inline void getMemoryWatermarks(MemoryWatermarks * const marks)
+{
+#if defined(__AVR__)
+    scanMemoryWatermarks(&__heap_start, (const byte *)RAMEND + 1, marks);
+#else
+    marks->heapPeak = 0;
+    marks->stackPeak = 0;
+    marks->minGap = 0;
+#endif // __AVR__
+}
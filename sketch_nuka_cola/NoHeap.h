@@ -0,0 +1,77 @@
+/**
+ * @file    NoHeap.h
+ *
+ * @brief   Provides an untested link time check that nothing allocates from
+ *          the heap.
+ *          With NO_HEAP defined, the allocation functions are replaced with
+ *          versions that reference a symbol which is never defined. The
+ *          Arduino build places each function in its own section and discards
+ *          those that are unused (--gc-sections), so the replacements should
+ *          only reach the linker, and fail the link, if something calls them.
+ *          free() is not replaced: it is defined by the same avr-libc object
+ *          as malloc(), and so is __brkval, so a reference to either pulls
+ *          that object in and fails the link with malloc() defined twice.
+ *          Nothing else in the sketch may reference them with the heap
+ *          disabled (see freeMemory() in MemoryMonitor.h). The C++ release
+ *          operators do nothing, as nothing can be allocated.
+ *          This has not been tried with avr-gcc. In particular, a core that
+ *          defines its own operator new could fail the link with multiple
+ *          definitions even when nothing allocates, and link time
+ *          optimisation may change which calls survive to the linker, so a
+ *          link that succeeds is not proof that nothing allocates.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+
+/// @brief  Uncomment to check at link time that nothing allocates from the
+///         heap (untested, see above).
+// #define NO_HEAP
+
+#if defined(NO_HEAP) && defined(__AVR__)
+
+/// @brief  Deliberately never defined. An undefined reference to this at link
+///         time means something in the build allocates from the heap.
+extern "C" void heap_allocation_is_disabled_see_NoHeap_h();
+
+extern "C" void *malloc(size_t)
+{
+    heap_allocation_is_disabled_see_NoHeap_h();
+    return nullptr;
+}
+
+extern "C" void *calloc(size_t, size_t)
+{
+    heap_allocation_is_disabled_see_NoHeap_h();
+    return nullptr;
+}
+
+extern "C" void *realloc(void *, size_t)
+{
+    heap_allocation_is_disabled_see_NoHeap_h();
+    return nullptr;
+}
+
+void *operator new(size_t)
+{
+    heap_allocation_is_disabled_see_NoHeap_h();
+    return nullptr;
+}
+
+void *operator new[](size_t)
+{
+    heap_allocation_is_disabled_see_NoHeap_h();
+    return nullptr;
+}
+
+void operator delete(void *)
+{
+}
+
+void operator delete[](void *)
+{
+}
+
+#endif // NO_HEAP && __AVR__
@@ -8,6 +8,9 @@
  * @date    2020
  */
 #pragma once
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
 
 // @TODO Have a better means of identifying whether EEPROM available.
 #if defined(ARDUINO_ARCH_SAMD)
@@ -21,28 +24,60 @@
 /**
  * Class to wrap around the EEPROM get/put functions, to make reading and
  * writing slightly easier.
+ * The value is read from EEPROM once by load() and then held in SRAM, acting
+ * as a cache. Reads never touch EEPROM. Writes update the cached copy
+ * and mark it as dirty, with the commit to EEPROM deferred until the value
+ * has been left unchanged for the commit delay. This coalesces bursts of
+ * changes (such as a held button) into a single commit, and only the bytes
+ * that differ from those already in EEPROM are written.
  */
 template<class T>
 class NonVol
 {
 public:
     /**
-     * @brief   Constructor - Takes the address to read/write in EEPROM
+     * @brief   Constructor - Takes the address to read/write in EEPROM. The
+     *          stored value is not read until load() is called.
      *
-     * @param   address     The EEPROM address to read and write
+     * @param   address         The EEPROM address to read and write
+     * @param   commitDelayMs   The time in milliseconds the value must remain
+     *                          unchanged before being committed to EEPROM. A
+     *                          value of zero commits on every change.
      */
-    NonVol(const int address)
+    NonVol(const int address, const unsigned long commitDelayMs=0)
     : address(address)
+    , commitDelayMs(commitDelayMs)
+    , lastChangeMs(0)
+    , dirty(false)
+    , writeCount(0)
+    , avoidedCount(0)
     { }
 
     /**
-     * @brief   Read functor - Gets the value currently stored in memory.
+     * @brief   Destructor.
+     */
+    virtual ~NonVol()
+    { }
+
+    /**
+     * @brief   Loads the currently stored value into the cache. This reads
+     *          EEPROM, so it is called from setup() rather than from the
+     *          constructor, which for a global object runs before the
+     *          Arduino core has been initialised.
+     */
+    virtual void load()
+    {
+        EEPROM.get(address, value);
+    }
+
+    /**
+     * @brief   Read functor - Gets the cached value.
      *
      * @return  Reference to the value.
      */
-    T operator() ()
+    const T &operator() () const
     {
-        return EEPROM.get(address, this->value);
+        return value;
     }
 
     /**
@@ -51,9 +86,20 @@ public:
      *
      * @return  Reference to the underlying value.
      */
-    operator T() const
+    operator const T&() const
+    {
+        return value;
+    }
+
+    /**
+     * @brief   Member access to the cached value, to save copying the whole
+     *          object when only a single field is required.
+     *
+     * @return  Pointer to the cached value.
+     */
+    const T *operator->() const
     {
-        return EEPROM.get(address, this->value);
+        return &value;
     }
 
     /**
@@ -64,27 +110,408 @@ public:
      *
      * @return  Reference to this object.
      */
-    NonVol& operator=(T other)
+    NonVol& operator=(const T &other)
     {
-        this->value = other;
-        EEPROM.put(address, other);
+        (*this)(other);
         return *this;
     }
 
     /**
-     * @brief   Write functor - Writes the new value to memory
+     * @brief   Write functor - Updates the cached value and schedules it to be
+     *          committed to EEPROM.
      *
      * @param   value   The template object value to be written to EEPROM.
      */
-    void operator() (T value)
+    void operator() (const T &value)
+    {
+        if (memcmp(&this->value, &value, sizeof(T)) != 0)
+        {
+            // A change that has not yet been committed is about to be
+            // replaced, so the whole of its write has been avoided.
+            if (dirty)
+            {
+                avoidedCount += sizeof(T);
+            }
+            this->value = value;
+            dirty = true;
+            lastChangeMs = millis();
+            if (commitDelayMs == 0)
+            {
+                commit();
+            }
+        }
+    }
+
+    /**
+     * @brief   Poll function, to be run once per loop operation. Commits any
+     *          pending change once the commit delay has passed.
+     */
+    void poll()
     {
-        this->value = value;
-        EEPROM.put(address, value);
+        if (dirty && (millis() - lastChangeMs) >= commitDelayMs)
+        {
+            commit();
+        }
     }
 
+    /**
+     * @brief   Immediately commits any pending change to EEPROM.
+     */
+    void flush()
+    {
+        if (dirty)
+        {
+            commit();
+        }
+    }
+
+    /**
+     * @brief   Sets the time a value must remain unchanged before it is
+     *          committed to EEPROM.
+     *
+     * @param   delayMs     The commit delay in milliseconds
+     */
+    void setCommitDelay(const unsigned long delayMs)
+    {
+        commitDelayMs = delayMs;
+    }
+
+    /**
+     * @brief   Indicates whether there is a change waiting to be committed.
+     *
+     * @return  True if the cached value differs from EEPROM, false otherwise.
+     */
+    bool isDirty() const
+    {
+        return dirty;
+    }
+
+    /**
+     * @brief   Gets the number of EEPROM bytes written.
+     *
+     * @return  The number of bytes written since construction.
+     */
+    unsigned long getWriteCount() const
+    {
+        return writeCount;
+    }
+
+    /**
+     * @brief   Gets the number of EEPROM byte writes avoided, either because
+     *          the byte was already up to date, or because the change was
+     *          replaced before it was committed.
+     *
+     * @return  The number of byte writes avoided since construction.
+     */
+    unsigned long getAvoidedWriteCount() const
+    {
+        return avoidedCount;
+    }
+
+protected:
+    /**
+     * @brief   Constructor for derived storage layouts, which are responsible
+     *          for loading the cached value themselves.
+     *
+     * @param   commitDelayMs   The time in milliseconds the value must remain
+     *                          unchanged before being committed to EEPROM.
+     */
+    explicit NonVol(const unsigned long commitDelayMs)
+    : address(0)
+    , commitDelayMs(commitDelayMs)
+    , lastChangeMs(0)
+    , dirty(false)
+    , writeCount(0)
+    , avoidedCount(0)
+    { }
+
+    /**
+     * @brief   Writes the cached value to its location in EEPROM.
+     */
+    virtual void store()
+    {
+        writeBytes(address, &value, sizeof(T));
+    }
+
+    /**
+     * @brief   Writes a block of bytes to EEPROM, skipping any bytes that
+     *          already hold the correct value.
+     *
+     * @param   start   The EEPROM address to start writing at
+     * @param   data    Pointer to the bytes to be written
+     * @param   size    The number of bytes to write
+     */
+    void writeBytes(const int start, const void * const data, const unsigned int size)
+    {
+        const byte * const bytes = reinterpret_cast<const byte *>(data);
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            if (EEPROM.read(start + i) != bytes[i])
+            {
+                EEPROM.write(start + i, bytes[i]);
+                ++writeCount;
+            }
+            else
+            {
+                ++avoidedCount;
+            }
+        }
+    }
+
+    /// @brief  The cached copy of the value stored in EEPROM.
+    T value;
+
 private:
+    /**
+     * @brief   Commits the cached value to EEPROM.
+     */
+    void commit()
+    {
+        store();
+        dirty = false;
+    }
+
     /// @brief  The address within EEPROM to read/write.
     const int address;
-    /// @brief  The storage value for reading to/from.
-    T value;
+    /// @brief  The time the value must remain unchanged before committing.
+    unsigned long commitDelayMs;
+    /// @brief  The time of the last change to the cached value.
+    unsigned long lastChangeMs;
+    /// @brief  Whether the cached value has changes yet to be committed.
+    bool dirty;
+    /// @brief  The number of EEPROM bytes written.
+    unsigned long writeCount;
+    /// @brief  The number of EEPROM byte writes avoided.
+    unsigned long avoidedCount;
+};
+
+/**
+ * Wear-levelled variant of NonVol. Rather than being pinned to one address,
+ * each commit writes a new record to the next slot of a ring buffer spread
+ * over a region of EEPROM, so the wear is shared between all of the slots.
+ * Each record holds a sequence number and a CRC. Records are written in
+ * order around the ring, so on loading the newest valid record is found
+ * by following the run of consecutive sequence numbers from the first valid
+ * slot, stopping as soon as the run breaks. A record torn by a power cut
+ * part way through a commit fails its CRC, so the previous record is loaded.
+ * If no valid record is found, the value reads as erased EEPROM (all 0xFF).
+ * A region too small to hold a single record stores nothing.
+ */
+template<class T>
+class WearLevelledNonVol : public NonVol<T>
+{
+public:
+    /**
+     * @brief   Constructor - Takes the EEPROM region to spread the records
+     *          over. The newest valid record is not read until load() is
+     *          called.
+     *
+     * @param   start           The first EEPROM address of the region
+     * @param   length          The size of the region in bytes
+     * @param   commitDelayMs   The time in milliseconds the value must remain
+     *                          unchanged before being committed to EEPROM.
+     */
+    WearLevelledNonVol(
+        const int start,
+        const int length,
+        const unsigned long commitDelayMs=0
+    )
+    : NonVol<T>(commitDelayMs)
+    , start(start)
+    , slots(slotCount(length))
+    , slot(slots - 1)
+    , sequence(ERASED_SEQUENCE)
+    { }
+
+    using NonVol<T>::operator=;
+
+    /**
+     * @brief   Loads the newest valid record into the cache, or the erased
+     *          value if there is none.
+     */
+    virtual void load()
+    {
+        memset(&this->value, 0xFF, sizeof(T));
+        slot = slots - 1;
+        sequence = ERASED_SEQUENCE;
+        locateNewest();
+    }
+
+    /// @brief  The fewest slots worth wear levelling over. With a single slot
+    ///         a torn write would lose the value, as there is no previous
+    ///         record to fall back to.
+    static const int MIN_SLOTS = 2;
+
+    /**
+     * @brief   Gets the number of record slots a region of EEPROM holds.
+     *
+     * @param   length  The size of the region in bytes
+     *
+     * @return  The number of slots.
+     */
+    static constexpr int slotCount(const int length)
+    {
+        return length / sizeof(Record);
+    }
+
+    /**
+     * @brief   Gets the size of the region of EEPROM needed to hold a number
+     *          of record slots.
+     *
+     * @param   slots   The number of slots
+     *
+     * @return  The size of the region in bytes.
+     */
+    static constexpr int regionLength(const int slots)
+    {
+        return slots * sizeof(Record);
+    }
+
+    /**
+     * @brief   Gets the number of slots in the ring buffer, which is the
+     *          factor by which the wear on each EEPROM cell is reduced.
+     *
+     * @return  The number of record slots.
+     */
+    int getSlotCount() const
+    {
+        return slots;
+    }
+
+protected:
+    /**
+     * @brief   Writes the cached value as a new record in the next slot.
+     */
+    virtual void store()
+    {
+        if (slots == 0)
+        {
+            return;
+        }
+        Record record;
+        memset(&record, 0, sizeof(Record));
+        slot = (slot + 1) % slots;
+        sequence = nextSequence(sequence);
+        record.sequence = sequence;
+        record.value = this->value;
+        record.crc = crc8(&record, offsetof(Record, crc));
+        this->writeBytes(slotAddress(slot), &record, sizeof(Record));
+    }
+
+private:
+    /// @brief  The sequence number of erased EEPROM, which is never issued.
+    static const uint16_t ERASED_SEQUENCE = 0xFFFF;
+
+    /// @brief  The layout of each record within the ring buffer.
+    struct Record
+    {
+        uint16_t sequence;
+        T value;
+        byte crc;
+    };
+
+    /**
+     * @brief   Finds the newest valid record and loads it into the cache.
+     */
+    void locateNewest()
+    {
+        Record record;
+        int first = 0;
+        while (first < slots && !readRecord(first, record))
+        {
+            ++first;
+        }
+        if (first < slots)
+        {
+            slot = first;
+            sequence = record.sequence;
+            this->value = record.value;
+            // Follow the run of consecutive sequence numbers around the ring
+            for (int i = 1; i < slots; ++i)
+            {
+                const int next = (first + i) % slots;
+                if (!readRecord(next, record) ||
+                    record.sequence != nextSequence(sequence))
+                {
+                    break;
+                }
+                slot = next;
+                sequence = record.sequence;
+                this->value = record.value;
+            }
+        }
+    }
+
+    /**
+     * @brief   Reads the record held in the given slot.
+     *
+     * @param   index   The slot index to read
+     * @param   record  The record to populate
+     *
+     * @return  True if the record is valid, false otherwise.
+     */
+    bool readRecord(const int index, Record &record) const
+    {
+        EEPROM.get(slotAddress(index), record);
+        return record.sequence != ERASED_SEQUENCE &&
+            record.crc == crc8(&record, offsetof(Record, crc));
+    }
+
+    /**
+     * @brief   Gets the EEPROM address of the given slot.
+     *
+     * @param   index   The slot index
+     *
+     * @return  The address of the start of the slot.
+     */
+    int slotAddress(const int index) const
+    {
+        return start + (index * sizeof(Record));
+    }
+
+    /**
+     * @brief   Gets the sequence number following the one given, skipping
+     *          the erased value.
+     *
+     * @param   current     The current sequence number
+     *
+     * @return  The next sequence number.
+     */
+    static uint16_t nextSequence(const uint16_t current)
+    {
+        const uint16_t next = current + 1;
+        return next == ERASED_SEQUENCE ? 0 : next;
+    }
+
+    /**
+     * @brief   Calculates the CRC-8 (polynomial 0x07) of a block of bytes.
+     *
+     * @param   data    Pointer to the bytes
+     * @param   size    The number of bytes
+     *
+     * @return  The CRC of the bytes.
+     */
+    static byte crc8(const void * const data, const unsigned int size)
+    {
+        const byte * const bytes = reinterpret_cast<const byte *>(data);
+        byte crc = 0;
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            crc ^= bytes[i];
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    /// @brief  The first EEPROM address of the ring buffer.
+    const int start;
+    /// @brief  The number of record slots in the ring buffer.
+    const int slots;
+    /// @brief  The slot holding the newest record.
+    int slot;
+    /// @brief  The sequence number of the newest record.
+    uint16_t sequence;
 };
@@ -7,6 +7,7 @@
  * @date    2020
  */
 #pragma once
+#include <Arduino.h>
 
 /**
  * Class used to make handling output signals easier.
@@ -45,6 +46,7 @@ public:
     OutputHelper &operator=(const int value)
     {
         digitalWrite(pin, value ? HIGH : LOW);
+        return *this;
     }
 
 private:
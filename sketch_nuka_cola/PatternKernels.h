@@ -0,0 +1,812 @@
+/**
+ * @file    PatternKernels.h
+ *
+ * @brief   Provides the illumination pattern kernels. Each kernel draws a whole
+ *          frame in one call, working over the LEDs laid out as separate arrays
+ *          (structure of arrays) rather than one structure per LED. Anything
+ *          that is the same for every LED within a frame is worked out once,
+ *          before the loop over the LEDs.
+ *          LED positions are binary angles (phases), where 65536 is one
+ *          revolution, so differences between angles wrap around the circle
+ *          for free. Kernels produce brightness levels as a percentage of full
+ *          brightness; the global brightness is applied afterwards.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+#include "FastRandom.h"
+#include "PatternMath.h"
+
+/// @brief  The optional patterns built in to the firmware. Comment out any
+///         that are not wanted to save flash on space constrained boards; they
+///         are removed from the pattern list altogether. Just On is always
+///         built in. Alternatively, define CUSTOM_PATTERNS in the build flags
+///         along with the wanted PATTERN_* flags, leaving this file untouched.
+#if !defined(CUSTOM_PATTERNS)
+#define PATTERN_CHASE
+#define PATTERN_WAVE
+#define PATTERN_THROB
+#define PATTERN_HEARTBEAT
+#define PATTERN_RAINDROP
+#define PATTERN_FLAMES
+#define PATTERN_STATIC
+#define PATTERN_PARTICLES
+#endif // CUSTOM_PATTERNS
+
+/// @brief  Constants required to create a raindrop effect.
+enum RaindropConstants
+{
+    // The number of degrees the raindrop will appear over
+    RAINDROP_ANGLE = 12,
+    // The number of degrees the raindrop will take to brighten
+    RAMPUP_ANGLE = 3,
+    // The number of degrees the raindrop will fade over
+    RAMPDOWN_ANGLE = RAINDROP_ANGLE - RAMPUP_ANGLE
+};
+
+/// @brief  The number of particles each particle pool holds.
+static const byte PARTICLE_POOL_SIZE = 12;
+
+/// @brief  The number of each kind of particle spawned per revolution at full
+///         density.
+static const byte MAX_DROP_SPAWNS = 48;
+static const byte MAX_COMET_SPAWNS = 6;
+static const byte MAX_SPARK_SPAWNS = 32;
+
+/// @brief  The lifetime of each kind of particle as a binary angle, so
+///         particles live for a fraction of a revolution and keep pace with
+///         the speed setting.
+static const uint16_t DROP_LIFE = 0x1000;
+static const uint16_t COMET_LIFE = 0x8000;
+static const uint16_t SPARK_LIFE = 0x2000;
+
+/// @brief  The length of the tail of a comet as a binary angle.
+static const uint16_t COMET_TAIL = 0x4000;
+
+/// @brief  The kinds of particle.
+enum ParticleKind
+{
+    // Appears in place, brightening quickly then fading
+    PARTICLE_DROP,
+    // Travels clockwise around the ring, trailing a fading tail
+    PARTICLE_COMET_CW,
+    // Travels anti-clockwise around the ring, trailing a fading tail
+    PARTICLE_COMET_ACW,
+    // Appears in place at full brightness, then dies away
+    PARTICLE_SPARK,
+};
+
+/// @brief  A single particle.
+struct Particle
+{
+    // The position around the circle as a binary angle
+    uint16_t position;
+    // The time since the particle was spawned as a binary angle
+    uint16_t age;
+    // The ParticleKind
+    byte kind;
+};
+
+/// @brief  A fixed size pool of particles. The active particles are kept
+///         together at the start, so only they are visited each frame.
+struct ParticlePool
+{
+    // The particles, of which the first active are in use
+    Particle particles[PARTICLE_POOL_SIZE];
+    // The number of particles in use
+    byte active;
+    // The phase of the lead point when the pool was last stepped
+    uint16_t lastPhase;
+    // The particles due to be spawned, in 1/65536ths of a particle
+    uint32_t spawnCredit;
+};
+
+/// @brief  Everything a pattern kernel needs to draw a frame: the position of
+///         the "lead" point of the circle, and the LEDs.
+struct PatternContext
+{
+    // The current angle of the lead point in whole degrees
+    int angle;
+    // The current angle of the lead point as a binary angle
+    uint16_t phase;
+    // The revolution number, good for identifying when a new cycle has started
+    long revolution;
+    // The number of LEDs
+    byte count;
+    // The position of each LED around the circle as a binary angle
+    const uint16_t *ledPhases;
+    // Pattern specific state for each LED
+    int *extras;
+    // The brightness level of each LED as a percentage, set by the kernel
+    byte *levels;
+    // The particle density as a percentage, for the particle patterns
+    byte density;
+    // The particle pool, for the particle patterns
+    ParticlePool *particles;
+    // The random number generator, for the random patterns
+    FastRandom *rng;
+};
+
+/// @brief  Type definition for an illumination pattern kernel.
+typedef void (*PatternKernel)(const PatternContext &context);
+
+/*******************************************************************************
+ * @brief   Sets every LED to the same brightness level.
+ *
+ * @param   context     The pattern context to draw into
+ * @param   level       The brightness level as a percentage
+ */
+static inline void fillLevels(const PatternContext &context, const byte level)
+{
+    memset(context.levels, level, context.count);
+}
+
+/*******************************************************************************
+ * @brief   Blends the brightness levels of another pattern into the levels
+ *          already drawn, for crossfading from one pattern to the next.
+ *
+ * @param   context     The pattern context holding the incoming levels, which
+ *                      are overwritten with the blend
+ * @param   from        The outgoing brightness levels
+ * @param   mix         The weight of the incoming levels, from 0 (all
+ *                      outgoing) to 256 (all incoming)
+ */
+static inline void crossfadeLevels(
+    const PatternContext &context,
+    const byte * const from,
+    const uint16_t mix
+)
+{
+    const uint16_t fade = 256 - mix;
+    for (byte i = 0; i < context.count; ++i)
+    {
+        context.levels[i] = ((from[i] * fade) + (context.levels[i] * mix) + 128) >> 8;
+    }
+}
+
+/// @brief  The ways a pattern layer can be blended with the levels beneath it.
+enum BlendMode
+{
+    // The layer is not drawn
+    BLEND_OFF,
+    // The levels are added together, saturating at full brightness
+    BLEND_ADD,
+    // The brighter of the two levels is taken
+    BLEND_MAX,
+    // The levels are multiplied, so the layer can only darken
+    BLEND_MULTIPLY,
+    // The inverted levels are multiplied, so the layer can only brighten
+    BLEND_SCREEN,
+
+    BLEND_MODE_COUNT
+};
+
+/*******************************************************************************
+ * @brief   Blends a pattern layer with the brightness levels already drawn.
+ *
+ * @param   context     The pattern context holding the levels beneath the
+ *                      layer, which are overwritten with the blend
+ * @param   layer       The brightness levels of the layer
+ * @param   mode        The BlendMode to apply
+ * @param   opacity     The weight of the blended levels, from 0 (leaving the
+ *                      levels beneath untouched) to 256 (fully opaque)
+ */
+static inline void blendLevels(
+    const PatternContext &context,
+    const byte * const layer,
+    const byte mode,
+    const uint16_t opacity
+)
+{
+    const uint16_t transparency = 256 - opacity;
+    for (byte i = 0; i < context.count; ++i)
+    {
+        const byte below = context.levels[i];
+        const byte above = layer[i];
+        byte blended = below;
+        switch (mode)
+        {
+            case BLEND_ADD:
+                blended = min(below + above, 100);
+                break;
+
+            case BLEND_MAX:
+                blended = max(below, above);
+                break;
+
+            case BLEND_MULTIPLY:
+                blended = multiplyPercent(below, above);
+                break;
+
+            case BLEND_SCREEN:
+                blended = 100 - multiplyPercent(100 - below, 100 - above);
+                break;
+
+            default:
+                break;
+        }
+        context.levels[i] = ((below * transparency) + (blended * opacity) + 128) >> 8;
+    }
+}
+
+/*******************************************************************************
+ * @brief   Lights are simply on at the global brightness
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void justOn(const PatternContext &context)
+{
+    fillLevels(context, 100);
+}
+
+#if defined(PATTERN_CHASE)
+/*******************************************************************************
+ * @brief   Gets the brightness level for an LED a given distance behind the
+ *          lead point of a chase, dimming from full to nothing over one
+ *          revolution.
+ *
+ * @param   distance    The distance behind the lead as a binary angle
+ *
+ * @return  The brightness level as a percentage.
+ */
+static inline byte chaseLevel(const uint16_t distance)
+{
+    return 100 - q8ToPercent(distance >> 8);
+}
+
+/*******************************************************************************
+ * @brief   Chase mode (anti-clockwise).
+ *          Chasing - The lead LED comes on at full brightness, and dims as
+ *          the head of the circle moves around.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void chaseModeAcw(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        context.levels[i] = chaseLevel(context.phase + context.ledPhases[i]);
+    }
+}
+
+/*******************************************************************************
+ * @brief   Chase mode (clockwise).
+ *          Chasing - The lead LED comes on at full brightness, and dims as
+ *          the head of the circle moves around.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void chaseModeCw(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        context.levels[i] = chaseLevel(context.phase - context.ledPhases[i]);
+    }
+}
+
+/*******************************************************************************
+ * @brief   Chase mode (both).
+ *          Chasing - The lead LED comes on at full brightness, and dims as
+ *          the head of the circle moves around. With this case, the head of
+ *          the circle is mirrored at 180 degrees.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void chaseModeBoth(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        const uint16_t distance = min(
+            (uint16_t)(context.phase - context.ledPhases[i]),
+            (uint16_t)(context.phase + context.ledPhases[i])
+        );
+        context.levels[i] = chaseLevel(distance);
+    }
+}
+#endif // PATTERN_CHASE
+
+#if defined(PATTERN_WAVE)
+/*******************************************************************************
+ * @brief   Gets the brightness level for an LED a given distance either side
+ *          of the peak of a wave, dimming from full to nothing at half a
+ *          revolution away.
+ *
+ * @param   offset  The offset from the peak as a binary angle
+ *
+ * @return  The brightness level as a percentage.
+ */
+static inline byte waveLevel(const uint16_t offset)
+{
+    // The distance either way round the circle, up to half a revolution
+    const uint16_t distance = (offset & HALF_PHASE) ? -offset : offset;
+    return 100 - q8ToPercent(distance >> 7);
+}
+
+/*******************************************************************************
+ * @brief   Wave mode (clockwise)
+ *          The peak of the circle is brightest, with the area surrounding
+ *          it dimming gently to nothing at 180 degrees away. LEDs more than
+ *          180 degrees past the peak, without wrapping around, are left off.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void waveModeCw(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        const uint16_t ledPhase = context.ledPhases[i];
+        const bool cutOff =
+            (ledPhase > context.phase) && ((uint16_t)(ledPhase - context.phase) > HALF_PHASE);
+        context.levels[i] = cutOff ? 0 : waveLevel(context.phase - ledPhase);
+    }
+}
+
+/*******************************************************************************
+ * @brief   Wave mode (anti-clockwise)
+ *          The peak of the circle is brightest, with the area surrounding
+ *          it dimming gently to nothing at 180 degrees away.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void waveModeAcw(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        context.levels[i] = waveLevel(context.phase - context.ledPhases[i]);
+    }
+}
+#endif // PATTERN_WAVE
+
+#if defined(PATTERN_THROB)
+/*******************************************************************************
+ * @brief   Throb mode
+ *          The lights all throb from off to on in unison.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void throbMode(const PatternContext &context)
+{
+    fillLevels(context, waveToPercent(cos16(context.phase)));
+}
+
+/*******************************************************************************
+ * @brief   Throb mode
+ *          The lights all throb from off to on in unison.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void throbMode2(const PatternContext &context)
+{
+    // Twice the distance from 180 degrees, rounded to whole degrees. Each
+    // degree of the doubled angle is 65536 / 180 (~364) in phase.
+    const unsigned int distance = (context.phase < HALF_PHASE) ?
+        HALF_PHASE - context.phase : context.phase - HALF_PHASE;
+    const unsigned int degrees = ((unsigned long)distance * 360 + HALF_PHASE) >> 16;
+    fillLevels(context, waveToPercent(sin16(degrees * 364)));
+}
+#endif // PATTERN_THROB
+
+#if defined(PATTERN_HEARTBEAT)
+/*******************************************************************************
+ * @brief   Heartbeat mode.
+ *          Provides two pulses per revolution.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void heartbeatMode(const PatternContext &context)
+{
+    // The angle rounded to the nearest whole degree
+    const int angle = ((unsigned long)context.phase * 360 + HALF_PHASE) >> 16;
+    const int delta = min(abs(225 - angle), abs(135 - angle));
+    const int value = 100 - (2 * rampPercent(delta, 135));
+    fillLevels(context, max(value, 0));
+}
+#endif // PATTERN_HEARTBEAT
+
+#if defined(PATTERN_RAINDROP)
+/*******************************************************************************
+ * @brief   Raindrop mode.
+ *          Each light randomly lights up quickly then fades once per
+ *          revolution. The extra value of each LED is the angle its drop
+ *          starts at, in whole degrees.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void raindropMode(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        const int position = context.angle - context.extras[i];
+        byte level = 0;
+        if (position >= 0 && position < RaindropConstants::RAMPUP_ANGLE)
+        {
+            // Ramp up
+            level = rampPercent(position, RaindropConstants::RAMPUP_ANGLE);
+        }
+        else if ((position >= RaindropConstants::RAMPUP_ANGLE) &&
+                (position < RaindropConstants::RAINDROP_ANGLE))
+        {
+            // Ramp down
+            level = 100 - rampPercent(
+                position - RaindropConstants::RAMPUP_ANGLE,
+                RaindropConstants::RAMPDOWN_ANGLE
+            );
+        }
+        context.levels[i] = level;
+    }
+}
+
+/*******************************************************************************
+ * @brief   Picks a new start angle for each raindrop, to be called once per
+ *          revolution.
+ *
+ * @param   context     The pattern context holding the LEDs
+ */
+static inline void populateRaindrops(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        context.extras[i] = context.rng->below(360 - RaindropConstants::RAINDROP_ANGLE);
+    }
+}
+#endif // PATTERN_RAINDROP
+
+#if defined(PATTERN_FLAMES) || defined(PATTERN_STATIC)
+/// @brief  A band of flicker within a flame, from a slow sway to a fast
+///         flutter.
+struct FlickerBand
+{
+    // The time between the points of the noise function, as a power of two
+    // of a binary angle, so higher is slower
+    byte shift;
+    // The amount the band can move the brightness either way, as a
+    // percentage
+    byte amplitude;
+    // Whether the band is shared between the LEDs, offset by their position
+    // around the circle, so that neighbouring LEDs sway together. Otherwise
+    // each LED flickers on its own.
+    bool spatial;
+};
+
+/// @brief  The brightness level flames flicker around, as a percentage.
+static const byte FLAME_BASE_LEVEL = 50;
+
+/// @brief  The bands of flicker within a flame, added together. Adjust these
+///         to taste; the amplitudes should add up to no more than
+///         FLAME_BASE_LEVEL for the flame never to go out.
+static const FlickerBand FLAME_BANDS[] PROGMEM =
+{
+    { 14, 24, true },
+    { 11, 16, false },
+    { 10, 10, false },
+};
+
+/// @brief  The number of flicker bands.
+static const byte FLAME_BAND_COUNT = sizeof(FLAME_BANDS) / sizeof(FLAME_BANDS[0]);
+
+/*******************************************************************************
+ * @brief   Gives each LED its own flicker, by picking a random seed for its
+ *          noise functions. The seed is held in the extra value of each LED.
+ *
+ * @param   context     The pattern context holding the LEDs
+ */
+static inline void seedFlames(const PatternContext &context)
+{
+    for (byte i = 0; i < context.count; ++i)
+    {
+        context.extras[i] = context.rng->nextByte();
+    }
+}
+
+/*******************************************************************************
+ * @brief   Draws a flickering flame into the brightness levels, by adding
+ *          bands of fixed point value noise to the base level. The noise moves
+ *          with the lead point, so the speed setting sets how fast the flames
+ *          flicker. The noise is evenly spread either side of its middle, so
+ *          the brightness always averages out at the base level.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void drawFlames(const PatternContext &context)
+{
+    FlickerBand bands[FLAME_BAND_COUNT];
+    memcpy_P(bands, FLAME_BANDS, sizeof(bands));
+    const uint32_t time = ((uint32_t)context.revolution << 16) | context.phase;
+    for (byte i = 0; i < context.count; ++i)
+    {
+        int level = FLAME_BASE_LEVEL;
+        for (byte b = 0; b < FLAME_BAND_COUNT; ++b)
+        {
+            const FlickerBand &band = bands[b];
+            const uint32_t position = band.spatial ? time + context.ledPhases[i] : time;
+            const byte seed = band.spatial ? 0 : context.extras[i];
+            const int noise = valueNoise(
+                position >> band.shift,
+                position >> (band.shift - 8),
+                seed
+            );
+            level += (band.amplitude * ((2 * noise) - 255)) / 256;
+        }
+        context.levels[i] = constrain(level, 0, 100);
+    }
+}
+#endif // PATTERN_FLAMES || PATTERN_STATIC
+
+#if defined(PATTERN_FLAMES)
+/*******************************************************************************
+ * @brief   Candle (flame) mode.
+ *          The LEDs flicker like flames, each on its own but with neighbouring
+ *          LEDs swaying together.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void candleMode(const PatternContext &context)
+{
+    drawFlames(context);
+}
+#endif // PATTERN_FLAMES
+
+#if defined(PATTERN_STATIC)
+/*******************************************************************************
+ * @brief   Static noise mode.
+ *          Fairly random flickering. This is based on candle mode, but with
+ *          some additional spikes of noise added.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void staticMode(const PatternContext &context)
+{
+    drawFlames(context);
+    for (byte i = 0; i < context.count; ++i)
+    {
+        const int level = context.levels[i] + context.rng->between(-10, 40);
+        context.levels[i] = constrain(level, 0, 100);
+    }
+}
+#endif // PATTERN_STATIC
+
+#if defined(PATTERN_PARTICLES)
+/*******************************************************************************
+ * @brief   Gets the lifetime of a kind of particle.
+ *
+ * @param   kind    The ParticleKind
+ *
+ * @return  The lifetime as a binary angle.
+ */
+static inline uint16_t particleLife(const byte kind)
+{
+    switch (kind)
+    {
+        case PARTICLE_COMET_CW:     // Deliberate fall-through
+        case PARTICLE_COMET_ACW:
+            return COMET_LIFE;
+
+        case PARTICLE_SPARK:
+            return SPARK_LIFE;
+
+        case PARTICLE_DROP:         // Deliberate fall-through
+        default:
+            return DROP_LIFE;
+    }
+}
+
+/*******************************************************************************
+ * @brief   Empties the particle pool, to be called when a particle pattern is
+ *          selected.
+ *
+ * @param   context     The pattern context holding the particle pool
+ */
+static inline void resetParticles(const PatternContext &context)
+{
+    ParticlePool &pool = *context.particles;
+    pool.active = 0;
+    pool.lastPhase = context.phase;
+    pool.spawnCredit = 0;
+}
+
+/*******************************************************************************
+ * @brief   Fills the particle pool the next time the pool is stepped, however
+ *          little time has passed. Used to measure a full pool.
+ *
+ * @param   context     The pattern context holding the particle pool
+ */
+static inline void primeParticles(const PatternContext &context)
+{
+    context.particles->spawnCredit = (uint32_t)PARTICLE_POOL_SIZE << 16;
+}
+
+/*******************************************************************************
+ * @brief   Ages and moves the particles by the time since the last frame,
+ *          removing any that have expired, then spawns new particles at the
+ *          rate set by the density. Expired particles are replaced by the last
+ *          active particle, so the cost depends only on the number active.
+ *
+ * @param   context     The pattern context holding the particle pool
+ * @param   kind        The ParticleKind to spawn, where comets travel in a
+ *                      random direction
+ * @param   maxSpawns   The particles spawned per revolution at full density
+ */
+static inline void stepParticles(
+    const PatternContext &context,
+    const byte kind,
+    const byte maxSpawns
+)
+{
+    ParticlePool &pool = *context.particles;
+    const uint16_t delta = context.phase - pool.lastPhase;
+    pool.lastPhase = context.phase;
+    byte i = 0;
+    while (i < pool.active)
+    {
+        Particle &particle = pool.particles[i];
+        if ((uint32_t)particle.age + delta >= particleLife(particle.kind))
+        {
+            particle = pool.particles[--pool.active];
+        }
+        else
+        {
+            particle.age += delta;
+            // Comets travel at twice the speed of the lead point
+            if (particle.kind == PARTICLE_COMET_CW)
+            {
+                particle.position += delta << 1;
+            }
+            else if (particle.kind == PARTICLE_COMET_ACW)
+            {
+                particle.position -= delta << 1;
+            }
+            ++i;
+        }
+    }
+    const byte spawnsPerRevolution =
+        ((maxSpawns * context.density) + 50) / 100;
+    pool.spawnCredit += (uint32_t)delta * spawnsPerRevolution;
+    while (pool.spawnCredit >= 0x10000 && pool.active < PARTICLE_POOL_SIZE)
+    {
+        pool.spawnCredit -= 0x10000;
+        Particle &particle = pool.particles[pool.active++];
+        particle.position = context.rng->next();
+        particle.age = 0;
+        particle.kind = kind;
+        if (kind == PARTICLE_COMET_CW && (context.rng->nextByte() & 1))
+        {
+            particle.kind = PARTICLE_COMET_ACW;
+        }
+    }
+    // Anything that could not be spawned into a full pool is dropped, rather
+    // than arriving in a burst later
+    if (pool.active == PARTICLE_POOL_SIZE)
+    {
+        pool.spawnCredit &= 0xFFFF;
+    }
+}
+
+/*******************************************************************************
+ * @brief   Gets the brightness of a particle over its lifetime.
+ *
+ * @param   particle    The particle
+ *
+ * @return  The brightness as a Q0.8 fraction, from 0 to 256.
+ */
+static inline uint16_t particleEnvelope(const Particle &particle)
+{
+    switch (particle.kind)
+    {
+        case PARTICLE_COMET_CW:     // Deliberate fall-through
+        case PARTICLE_COMET_ACW:
+            // Full brightness, fading over the last quarter of its life
+            return min((uint16_t)(COMET_LIFE - particle.age) >> 5, 256);
+
+        case PARTICLE_SPARK:
+            {
+                // Dies away quadratically
+                const uint16_t remaining = (SPARK_LIFE - particle.age) >> 5;
+                return (remaining * remaining) >> 8;
+            }
+
+        case PARTICLE_DROP:         // Deliberate fall-through
+        default:
+            // Brightens over the first fifth of its life, then fades
+            return min(particle.age >> 2, 256 - (particle.age >> 4));
+    }
+}
+
+/*******************************************************************************
+ * @brief   Gets how much of a particle's light falls on an LED.
+ *
+ * @param   particle    The particle
+ * @param   ledPhase    The position of the LED as a binary angle
+ * @param   count       The number of LEDs
+ *
+ * @return  The share of the light as a Q0.8 fraction, from 0 to 256.
+ */
+static inline uint16_t particleSpread(
+    const Particle &particle,
+    const uint16_t ledPhase,
+    const byte count
+)
+{
+    uint16_t weight = 0;
+    if (particle.kind == PARTICLE_COMET_CW || particle.kind == PARTICLE_COMET_ACW)
+    {
+        // The tail trails behind the head, dimming with distance
+        const uint16_t behind = (particle.kind == PARTICLE_COMET_CW) ?
+            particle.position - ledPhase : ledPhase - particle.position;
+        weight = (behind < COMET_TAIL) ? 256 - (behind >> 6) : 0;
+    }
+    else
+    {
+        // The light is shared between the LEDs either side
+        uint16_t distance = ledPhase - particle.position;
+        if (distance & HALF_PHASE)
+        {
+            distance = -distance;
+        }
+        const uint32_t scaled = (uint32_t)distance * count;
+        weight = (scaled < 0x10000) ? 256 - (scaled >> 8) : 0;
+    }
+    return weight;
+}
+
+/*******************************************************************************
+ * @brief   Draws every active particle, adding their light together.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void drawParticles(const PatternContext &context)
+{
+    const ParticlePool &pool = *context.particles;
+    fillLevels(context, 0);
+    for (byte p = 0; p < pool.active; ++p)
+    {
+        const Particle &particle = pool.particles[p];
+        const uint16_t intensity = (100 * particleEnvelope(particle)) >> 8;
+        for (byte i = 0; i < context.count; ++i)
+        {
+            const uint16_t weight = particleSpread(particle, context.ledPhases[i], context.count);
+            const uint16_t level = context.levels[i] + ((intensity * weight) >> 8);
+            context.levels[i] = min(level, (uint16_t)100);
+        }
+    }
+}
+
+/*******************************************************************************
+ * @brief   Drops mode.
+ *          Raindrops fall at random, brightening quickly then fading, and may
+ *          overlap one another.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void dropsMode(const PatternContext &context)
+{
+    stepParticles(context, PARTICLE_DROP, MAX_DROP_SPAWNS);
+    drawParticles(context);
+}
+
+/*******************************************************************************
+ * @brief   Comets mode.
+ *          Comets appear at random and travel around the ring in either
+ *          direction, trailing a fading tail.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void cometsMode(const PatternContext &context)
+{
+    stepParticles(context, PARTICLE_COMET_CW, MAX_COMET_SPAWNS);
+    drawParticles(context);
+}
+
+/*******************************************************************************
+ * @brief   Sparks mode.
+ *          Sparks flash at random at full brightness, then die away.
+ *
+ * @param   context     The pattern context to draw into
+ */
+static inline void sparksMode(const PatternContext &context)
+{
+    stepParticles(context, PARTICLE_SPARK, MAX_SPARK_SPAWNS);
+    drawParticles(context);
+}
+#endif // PATTERN_PARTICLES
@@ -0,0 +1,213 @@
+/**
+ * @file    PatternMath.h
+ *
+ * @brief   Provides integer and fixed-point maths helpers for the illumination
+ *          patterns. The AVR has no floating point unit, so these replace the
+ *          float trigonometry and division that would otherwise be carried out
+ *          for every LED on every frame.
+ *          Angles are binary angles (phases), where 65536 is one revolution.
+ *          Sine values are Q1.15, where 32767 represents 1.0.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+/// @brief  The phase of a quarter revolution (90 degrees).
+static const unsigned int QUARTER_PHASE = 0x4000;
+
+/// @brief  The phase of a half revolution (180 degrees).
+static const unsigned int HALF_PHASE = 0x8000;
+
+/// @brief  Quarter wave sine look up table, in Q1.15. There are 65 values,
+///         covering 0 to 90 degrees inclusive in steps of 90/64 degrees, so
+///         the last step can be interpolated without a special case.
+static const int SINE_QUARTER_WAVE[] PROGMEM =
+{
+        0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+     6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767
+};
+
+/*******************************************************************************
+ * @brief   Gets the sine of a binary angle, using the quarter wave table with
+ *          linear interpolation between entries.
+ *
+ * @param   phase   The angle, where 65536 is one revolution
+ *
+ * @return  The sine of the angle in Q1.15.
+ */
+static inline int sin16(const unsigned int phase)
+{
+    unsigned int position = phase & (QUARTER_PHASE - 1);
+    // The second and fourth quadrants are mirror images of the first
+    if (phase & QUARTER_PHASE)
+    {
+        position = QUARTER_PHASE - position;
+    }
+    const unsigned char index = position >> 8;
+    const unsigned char fraction = position & 0xFF;
+    int value = pgm_read_word(&SINE_QUARTER_WAVE[index]);
+    if (fraction != 0)
+    {
+        const int next = pgm_read_word(&SINE_QUARTER_WAVE[index + 1]);
+        value += ((long)(next - value) * fraction) >> 8;
+    }
+    // The second half of the revolution is negative
+    return (phase & HALF_PHASE) ? -value : value;
+}
+
+/*******************************************************************************
+ * @brief   Gets the cosine of a binary angle.
+ *
+ * @param   phase   The angle, where 65536 is one revolution
+ *
+ * @return  The cosine of the angle in Q1.15.
+ */
+static inline int cos16(const unsigned int phase)
+{
+    return sin16(phase + QUARTER_PHASE);
+}
+
+/*******************************************************************************
+ * @brief   Converts a Q1.15 wave value from -1.0 to 1.0 to a brightness
+ *          percentage from 0 to 100, i.e. (1 + value) * 50, rounded.
+ *
+ * @param   value   The wave value in Q1.15
+ *
+ * @return  The brightness percentage.
+ */
+static inline int waveToPercent(const int value)
+{
+    return 50 + (((long)value * 100 + 32768) >> 16);
+}
+
+/*******************************************************************************
+ * @brief   Linearly ramps a brightness percentage over a range, such that the
+ *          start of the range is 0% and the end is 100%, rounded to the nearest
+ *          whole percent.
+ *
+ * @param   position    The position within the range, from 0 to range
+ * @param   range       The size of the range, no more than 655
+ *
+ * @return  The brightness percentage.
+ */
+static inline int rampPercent(const unsigned int position, const unsigned int range)
+{
+    return ((100 * position) + (range / 2)) / range;
+}
+
+/*******************************************************************************
+ * @brief   Converts a Q0.8 fraction from 0 to 1.0 to a whole percentage from 0
+ *          to 100, rounded.
+ *
+ * @param   fraction    The fraction, from 0 to 256
+ *
+ * @return  The percentage.
+ */
+static inline byte q8ToPercent(const unsigned int fraction)
+{
+    return ((fraction * 100) + 128) >> 8;
+}
+
+/*******************************************************************************
+ * @brief   Converts a whole percentage from 0 to 100 to a Q0.8 fraction from 0
+ *          to 1.0, rounded.
+ *
+ * @param   percent     The percentage, from 0 to 100
+ *
+ * @return  The fraction, from 0 to 256.
+ */
+static inline unsigned int percentToQ8(const byte percent)
+{
+    return (((unsigned int)percent << 8) + 50) / 100;
+}
+
+/*******************************************************************************
+ * @brief   Multiplies two percentages together, rounded, so 50% of 50% is 25%.
+ *
+ * @param   a   The first percentage, from 0 to 100
+ * @param   b   The second percentage, from 0 to 100
+ *
+ * @return  The product as a percentage.
+ */
+static inline byte multiplyPercent(const byte a, const byte b)
+{
+    return ((unsigned int)(a * b) + 50) / 100;
+}
+
+/*******************************************************************************
+ * @brief   Hashes a lattice point of a noise function to a pseudo random value.
+ *          Every value is equally likely, and the values at neighbouring
+ *          points, or with different seeds, are unrelated.
+ *
+ * @param   lattice     The lattice point
+ * @param   seed        Selects one of 256 different noise functions
+ *
+ * @return  The value at the lattice point, from 0 to 255.
+ */
+static inline byte noiseHash(const uint16_t lattice, const byte seed)
+{
+    uint16_t hash = (lattice + ((uint16_t)seed << 8)) * 0x9E37;
+    hash ^= hash >> 7;
+    hash *= 0x5A3B;
+    return hash ^ (hash >> 8);
+}
+
+/*******************************************************************************
+ * @brief   Eases a Q0.8 fraction with the smoothstep curve 3f^2 - 2f^3, so
+ *          that interpolation starts and ends gently.
+ *
+ * @param   fraction    The fraction, from 0 to 255
+ *
+ * @return  The eased fraction, from 0 to 255.
+ */
+static inline byte smoothFraction(const byte fraction)
+{
+    return ((uint32_t)fraction * fraction * (765 - (2 * fraction))) >> 16;
+}
+
+/*******************************************************************************
+ * @brief   Gets the value of a one dimensional value noise function, smoothly
+ *          interpolated between the pseudo random values at the lattice
+ *          points either side.
+ *
+ * @param   lattice     The lattice point before the position
+ * @param   fraction    The position between the lattice points, as a Q0.8
+ *                      fraction
+ * @param   seed        Selects one of 256 different noise functions
+ *
+ * @return  The noise value, from 0 to 255.
+ */
+static inline byte valueNoise(const uint16_t lattice, const byte fraction, const byte seed)
+{
+    const uint16_t before = noiseHash(lattice, seed);
+    const uint16_t after = noiseHash(lattice + 1, seed);
+    const uint16_t weight = smoothFraction(fraction);
+    return ((before * (256 - weight)) + (after * weight) + 128) >> 8;
+}
+
+/*******************************************************************************
+ * @brief   Scales a value by a ratio, rounding half away from zero.
+ *
+ * @param   value       The value to scale
+ * @param   numerator   The numerator of the ratio
+ * @param   denominator The denominator of the ratio, greater than zero
+ *
+ * @return  The scaled value. The product of the value and numerator must fit
+ *          within an int.
+ */
+static inline int scaleRounded(const int value, const int numerator, const int denominator)
+{
+    const int product = value * numerator;
+    const int half = (product < 0) ? -(denominator / 2) : (denominator / 2);
+    return (product + half) / denominator;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file    PerfStats.h
+ *
+ * @brief   Provides lightweight performance counters, used to check whether a
+ *          unit is keeping up with its frame rate. The counters are gathered
+ *          through the PERF_* macros, which compile to nothing unless
+ *          PERF_STATS is defined, so the instrumentation costs nothing when
+ *          disabled.
+ *
+ * @author  Kris Dunning (ippie52@gmail.com)
+ * @date    2020
+ */
+#pragma once
+#include <Arduino.h>
+#include <limits.h>
+
+/// @brief  Uncomment to enable the performance counters and the "stats?"
+///         serial command.
+// #define PERF_STATS
+
+/// @brief  The subsystems that have their time measured.
+enum PerfSubsystem
+{
+    PerfSerial,
+    PerfInputs,
+    PerfLeds,
+
+    PERF_SUBSYSTEM_COUNT
+};
+
+/// @brief  The upper bounds of the frame interval histogram bins, in
+///         microseconds. Intervals beyond the last bound go in a final bin.
+static const unsigned long PERF_FRAME_BINS_US[] = {
+    19000, 20000, 21000, 22000, 25000, 40000
+};
+
+/// @brief  The number of frame interval histogram bins.
+static const unsigned char PERF_FRAME_BIN_COUNT =
+    (sizeof(PERF_FRAME_BINS_US) / sizeof(PERF_FRAME_BINS_US[0])) + 1;
+
+#if defined(PERF_STATS)
+
+/// @brief  The performance counters, gathered since they were last reset.
+struct PerfCounters
+{
+    // The time the counters were reset in milliseconds
+    unsigned long startMs;
+    // The number of loop iterations
+    unsigned long loops;
+    // The longest loop iteration in microseconds
+    unsigned long maxLoopUs;
+    // The time spent in each subsystem in microseconds
+    unsigned long subsystemUs[PERF_SUBSYSTEM_COUNT];
+    // The frame interval histogram. At 50 fps, a 16-bit count would wrap
+    // after 22 minutes, so these are 32-bit
+    unsigned long frameBins[PERF_FRAME_BIN_COUNT];
+};
+
+/// @brief  The performance counters.
+static PerfCounters perfCounters;
+
+/*******************************************************************************
+ * @brief   Clears the performance counters.
+ */
+static inline void perfReset()
+{
+    memset(&perfCounters, 0, sizeof(perfCounters));
+    perfCounters.startMs = millis();
+}
+
+/*******************************************************************************
+ * @brief   Adds to a counter, holding it at its maximum rather than wrapping.
+ *
+ * @param   counter The counter to add to
+ * @param   value   The value to add
+ */
+static inline void perfAdd(unsigned long &counter, const unsigned long value)
+{
+    counter = (counter > ULONG_MAX - value) ? ULONG_MAX : (counter + value);
+}
+
+/*******************************************************************************
+ * @brief   Gets the rate of a count per second. The count is widened before
+ *          it is scaled, as multiplying a 32-bit count by 1000 would overflow
+ *          once it passes 4.29 million, a few minutes of loops.
+ *
+ * @param   count       The count
+ * @param   elapsedMs   The time taken for the count in milliseconds, not zero
+ *
+ * @return  The count per second.
+ */
+static inline uint32_t perfPerSecond(const uint32_t count, const uint32_t elapsedMs)
+{
+    return (uint32_t)(((uint64_t)count * 1000) / elapsedMs);
+}
+
+/*******************************************************************************
+ * @brief   Adds a frame interval to the histogram.
+ *
+ * @param   intervalUs  The interval since the previous frame in microseconds
+ */
+static inline void perfFrameInterval(const unsigned long intervalUs)
+{
+    unsigned char bin = 0;
+    while (bin < PERF_FRAME_BIN_COUNT - 1 && intervalUs >= PERF_FRAME_BINS_US[bin])
+    {
+        ++bin;
+    }
+    perfAdd(perfCounters.frameBins[bin], 1);
+}
+
+/**
+ * Scoped timer, adding the time between its construction and destruction to
+ * a subsystem, or to the loop counters.
+ */
+class PerfTimer
+{
+public:
+    /***************************************************************************
+     * @brief   Constructor - Takes the subsystem being timed and starts timing.
+     *
+     * @param   subsystem   The subsystem being timed, or PERF_SUBSYSTEM_COUNT
+     *                      to time a loop iteration.
+     */
+    explicit PerfTimer(const PerfSubsystem subsystem)
+    : subsystem(subsystem)
+    , startUs(micros())
+    { }
+
+    /***************************************************************************
+     * @brief   Destructor - Stops timing and updates the counters.
+     */
+    ~PerfTimer()
+    {
+        const unsigned long elapsedUs = micros() - startUs;
+        if (subsystem == PERF_SUBSYSTEM_COUNT)
+        {
+            ++perfCounters.loops;
+            perfCounters.maxLoopUs = max(perfCounters.maxLoopUs, elapsedUs);
+        }
+        else
+        {
+            perfAdd(perfCounters.subsystemUs[subsystem], elapsedUs);
+        }
+    }
+
+private:
+    /// @brief  The subsystem being timed.
+    const PerfSubsystem subsystem;
+    /// @brief  The time timing started in microseconds.
+    const unsigned long startUs;
+};
+
+/// @brief  Times the rest of the enclosing scope against a subsystem.
+#define PERF_SCOPE(subsystem)           PerfTimer perfTimer(subsystem)
+/// @brief  Times the rest of the enclosing scope as a loop iteration.
+#define PERF_LOOP_SCOPE()               PerfTimer perfLoopTimer(PERF_SUBSYSTEM_COUNT)
+/// @brief  Adds a frame interval to the histogram.
+#define PERF_FRAME_INTERVAL(intervalUs) perfFrameInterval(intervalUs)
+
+#else
+
+#define PERF_SCOPE(subsystem)
+#define PERF_LOOP_SCOPE()
+#define PERF_FRAME_INTERVAL(intervalUs)
+
+#endif // PERF_STATS
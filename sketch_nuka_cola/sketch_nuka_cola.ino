@@ -11,6 +11,9 @@
 #include "LedCluster.h"
 #include "InputHelper.h"
 #include "OutputHelper.h"
+#include "PerfStats.h"
+#include "MemoryMonitor.h"
+#include "NoHeap.h"
 
 /**
  * Constants
@@ -22,12 +25,59 @@
 #define SPEED_MODE_CHAR         'S'
 /// @brief  Serial input to increment the brightness.
 #define BRIGHTNESS_MODE_CHAR    'B'
+/// @brief  Serial input to increment the transition time.
+#define TRANSITION_MODE_CHAR    'T'
+/// @brief  Serial input to increment the particle density.
+#define DENSITY_MODE_CHAR       'D'
+/// @brief  Serial input to set up a pattern layer.
+#define LAYER_MODE_CHAR         'L'
 /// @brief  Serial input to set into running mode.
 #define RUNNING_MODE_CHAR       'R'
 /// @brief  Serial input to set into sleep mode.
 #define SLEEP_MODE_CHAR         'X'
 /// @brief  API request string.
 #define API_REQUEST_STR         "api?"
+/// @brief  Frame timing statistics request string.
+#define FRAME_STATS_REQUEST_STR "frames?"
+/// @brief  Output write rate request string.
+#define WRITE_STATS_REQUEST_STR "writes?"
+/// @brief  Pattern benchmark request string.
+#define BENCHMARK_REQUEST_STR   "bench?"
+/// @brief  Performance counters request string.
+#define PERF_STATS_REQUEST_STR  "stats?"
+/// @brief  Memory watermark request string.
+#define MEMORY_REQUEST_STR      "mem?"
+/// @brief  Pattern catalog request string.
+#define PATTERNS_REQUEST_STR    "patterns?"
+/// @brief  Transition benchmark request string.
+#define FADE_BENCH_REQUEST_STR  "fade?"
+/// @brief  Pattern layer settings request string.
+#define LAYERS_REQUEST_STR      "layers?"
+/// @brief  Pattern layer benchmark request string.
+#define LAYER_BENCH_REQUEST_STR "layerbench?"
+/// @brief  Random seed command string, followed by '=' to set the seed.
+#define SEED_COMMAND_STR        "seed"
+/// @brief  Pattern trace command string, followed by '?' for every pattern
+///         or '=X' for pattern X.
+#define TRACE_COMMAND_STR       "trace"
+/// @brief  Particle benchmark request string.
+#define PARTICLE_REQUEST_STR    "particles?"
+
+/// @brief  The number of frames drawn per pattern when benchmarking.
+static const unsigned int BENCHMARK_FRAMES = 250;
+/// @brief  The time available to draw each frame in microseconds (50 fps).
+static const unsigned long FRAME_BUDGET_US = 20000;
+/// @brief  The random seed used for pattern traces.
+static const uint16_t TRACE_SEED = 1;
+/// @brief  The largest random seed, as the generator state is 16-bit.
+static const unsigned long MAX_SEED = 65535;
+/// @brief  The number of frames drawn per revolution for pattern traces.
+static const unsigned int TRACE_FRAMES_PER_REVOLUTION = 32;
+/// @brief  The number of revolutions drawn for pattern traces.
+static const unsigned int TRACE_REVOLUTIONS = 2;
+/// @brief  The longest serial command accepted, in characters, not including
+///         the end of the line.
+static const size_t SERIAL_COMMAND_LENGTH = 16;
 
 
 /**
@@ -48,8 +98,20 @@ enum SettingModes
   Speed
 };
 
-/// @brief  Pointer to an LED cluster, used to create illumination patterns.
-LedCluster *cluster = nullptr;
+/// @brief  The type of LED cluster driving the display LEDs, in order around
+///         the circle.
+typedef LedCluster<
+  NanoBoard,
+  Pins::DisplayLED1,
+  Pins::DisplayLED2,
+  Pins::DisplayLED3,
+  Pins::DisplayLED4,
+  Pins::DisplayLED5,
+  Pins::DisplayLED6
+> DisplayCluster;
+
+/// @brief  The LED cluster, used to create illumination patterns.
+DisplayCluster cluster;
 
 /// @brief  Up button input.
 InputHelper upBtn(Pins::SettingUpBtn, upBtnToggled);
@@ -75,6 +137,14 @@ SettingModes mode = SettingModes::Running;
 /// @brief  Stores when the last mode change occurred.
 long lastModeChange = 0;
 
+/// @brief  The serial command line being received.
+static char serialLine[SERIAL_COMMAND_LENGTH + 1];
+/// @brief  The number of characters received of the current line.
+static size_t serialLineLength = 0;
+/// @brief  Set when the current line is too long for the buffer, so the rest
+///         of it is dropped.
+static bool serialLineOverflow = false;
+
 /*******************************************************************************
  * @brief   Toggles the cluster value for the given setting mode.
  *
@@ -85,40 +155,37 @@ long lastModeChange = 0;
 static int toggleClusterValue(const int delta)
 {
   int value = 0;
-  if (cluster != nullptr)
+  switch (mode)
   {
-    switch (mode)
-    {
-      case SettingModes::Pattern:
-        lastModeChange = millis();
-        value = cluster->updatePattern(delta);
-        modeLED = LOW;
-        delay(80);
-        modeLED = HIGH;
-        break;
+    case SettingModes::Pattern:
+      lastModeChange = millis();
+      value = cluster.updatePattern(delta);
+      modeLED = LOW;
+      delay(80);
+      modeLED = HIGH;
+      break;
 
-      case SettingModes::Brightness:
-        lastModeChange = millis();
-        value = cluster->updateBrightness(delta);
-        brightnessLED = LOW;
-        delay(80);
-        brightnessLED = HIGH;
-        break;
+    case SettingModes::Brightness:
+      lastModeChange = millis();
+      value = cluster.updateBrightness(delta);
+      brightnessLED = LOW;
+      delay(80);
+      brightnessLED = HIGH;
+      break;
 
-      case SettingModes::Speed:
-        lastModeChange = millis();
-        value = cluster->updateSpeed(delta);
-        speedLED = LOW;
-        delay(80);
-        speedLED = HIGH;
-        break;
+    case SettingModes::Speed:
+      lastModeChange = millis();
+      value = cluster.updateSpeed(delta);
+      speedLED = LOW;
+      delay(80);
+      speedLED = HIGH;
+      break;
 
-      case SettingModes::Running: // Deliberate fall-through
-      case SettingModes::Sleep:   // Deliberate fall-through
-      default:
-        // Nothing to do
-        break;
-    }
+    case SettingModes::Running: // Deliberate fall-through
+    case SettingModes::Sleep:   // Deliberate fall-through
+    default:
+      // Nothing to do
+      break;
   }
   return value;
 }
@@ -130,7 +197,7 @@ static int toggleClusterValue(const int delta)
  */
 static void upBtnToggled(const int, const int state, const long)
 {
-  if (state && cluster != nullptr)
+  if (state)
   {
     toggleClusterValue(1);
   }
@@ -143,7 +210,7 @@ static void upBtnToggled(const int, const int state, const long)
  */
 static void downBtnToggled(const int, const int state, const long)
 {
-  if (state && cluster != nullptr)
+  if (state)
   {
     toggleClusterValue(-1);
   }
@@ -156,18 +223,15 @@ static void downBtnToggled(const int, const int state, const long)
  */
 static void powerTimeout(const int, const long)
 {
-  if (cluster != nullptr)
+  if (SettingModes::Sleep == mode)
   {
-    if (SettingModes::Sleep == mode)
-    {
-      mode = SettingModes::Running;
-      cluster->startUp();
-    }
-    else if (SettingModes::Running == mode)
-    {
-      mode = SettingModes::Sleep;
-      cluster->shutdown();
-    }
+    mode = SettingModes::Running;
+    cluster.startUp();
+  }
+  else if (SettingModes::Running == mode)
+  {
+    mode = SettingModes::Sleep;
+    cluster.shutdown();
   }
 }
 
@@ -176,7 +240,7 @@ static void powerTimeout(const int, const long)
  *
  * @param   newMode  The new mode to change to
  */
-static void setMode(const int newMode)
+static void setMode(const SettingModes newMode)
 {
   mode = newMode;
   modeLED = SettingModes::Pattern == mode;
@@ -192,7 +256,7 @@ static void setMode(const int newMode)
  */
 static void settingBtnToggled(const int, const int state, const long)
 {
-  if (state && cluster != nullptr)
+  if (state)
   {
     switch (mode)
     {
@@ -218,33 +282,488 @@ static void settingBtnToggled(const int, const int state, const long)
   }
 }
 
+/*******************************************************************************
+ * @brief   Sends a single API entry to the connected serial device, as the
+ *          description followed by the key in square brackets.
+ *
+ * @param   description     The description of the entry
+ * @param   key             The key or string used to access it
+ */
+template <typename Key>
+static void sendApiEntry(const __FlashStringHelper * const description, const Key key)
+{
+  Serial.print(description);
+  Serial.print(F(" ["));
+  Serial.print(key);
+  Serial.println(F("]"));
+}
+
 /*******************************************************************************
  * @brief   Sends the API to the connected serial device.
  */
 static void sendApi()
 {
-  Serial.println("Letter in square brackets is the key.");
-  Serial.println("Upper case increases, lower case decreases.");
-  Serial.println("To assign value, use '=X' where X is the value to set.");
-  Serial.println("Example: \"s=100\" sets Speed to 100%, and \"b\" decreases brightness one step.");
-  Serial.print(String("Pattern [") + PATTERN_MODE_CHAR + "] ");
+  Serial.println(F("Letter in square brackets is the key."));
+  Serial.println(F("Upper case increases, lower case decreases."));
+  Serial.println(F("To assign value, use '=X' where X is the value to set."));
+  Serial.println(F("Example: \"s=100\" sets Speed to 100%, and \"b\" decreases brightness one step."));
+  Serial.print(F("Pattern ["));
+  Serial.print(PATTERN_MODE_CHAR);
+  Serial.print(F("] "));
   for(int i = 0; i < Patterns::PATTERN_COUNT; i++)
   {
-    Serial.print(String(PATTERN_STRINGS[i]) + " (" + i + "),");
+    Serial.print(getPatternName(i));
+    Serial.print(F(" ("));
+    Serial.print(i);
+    Serial.print(F("),"));
   }
-  Serial.println("");
-  Serial.println(
-    String("Speed [") + SPEED_MODE_CHAR +"] " +
-    SpeedConstants::MIN_SPEED_PCT + "-" +
-    SpeedConstants::MAX_SPEED_PCT
-  );
-  Serial.println(
-    String("Brightness [") + BRIGHTNESS_MODE_CHAR + "] " +
-    BrightnessConstants::MIN_BRIGHTNESS_PCT + "-" +
-    BrightnessConstants::MAX_BRIGHTNESS_PCT
+  Serial.println();
+  Serial.print(F("Speed ["));
+  Serial.print(SPEED_MODE_CHAR);
+  Serial.print(F("] "));
+  Serial.print(SpeedConstants::MIN_SPEED_PCT);
+  Serial.print(F("-"));
+  Serial.println(SpeedConstants::MAX_SPEED_PCT);
+  Serial.print(F("Brightness ["));
+  Serial.print(BRIGHTNESS_MODE_CHAR);
+  Serial.print(F("] "));
+  Serial.print(BrightnessConstants::MIN_BRIGHTNESS_PCT);
+  Serial.print(F("-"));
+  Serial.println(BrightnessConstants::MAX_BRIGHTNESS_PCT);
+  Serial.print(F("Transition ms ["));
+  Serial.print(TRANSITION_MODE_CHAR);
+  Serial.print(F("] "));
+  Serial.print(TransitionConstants::MIN_TRANSITION_MS);
+  Serial.print(F("-"));
+  Serial.println(TransitionConstants::MAX_TRANSITION_MS);
+  Serial.print(F("Particle Density ["));
+  Serial.print(DENSITY_MODE_CHAR);
+  Serial.print(F("] "));
+  Serial.print(DensityConstants::MIN_DENSITY);
+  Serial.print(F("-"));
+  Serial.println(DensityConstants::MAX_DENSITY);
+  Serial.print(F("Layer ["));
+  Serial.print(LAYER_MODE_CHAR);
+  Serial.print(F("] l1-"));
+  Serial.print(LayerConstants::MAX_LAYERS);
+  Serial.println(F("=pattern,blend,opacity,rpm (blend 0 off, 1 add, 2 max, 3 multiply, 4 screen)"));
+  sendApiEntry(F("Running Mode"), RUNNING_MODE_CHAR);
+  sendApiEntry(F("Sleep Mode"), SLEEP_MODE_CHAR);
+  sendApiEntry(F("Frame Timing"), F(FRAME_STATS_REQUEST_STR));
+  sendApiEntry(F("Output Writes"), F(WRITE_STATS_REQUEST_STR));
+  sendApiEntry(F("Pattern Benchmark"), F(BENCHMARK_REQUEST_STR));
+  sendApiEntry(F("Transition Benchmark"), F(FADE_BENCH_REQUEST_STR));
+  sendApiEntry(F("Layers"), F(LAYERS_REQUEST_STR));
+  sendApiEntry(F("Layer Benchmark"), F(LAYER_BENCH_REQUEST_STR));
+  sendApiEntry(F("Particle Benchmark"), F(PARTICLE_REQUEST_STR));
+  sendApiEntry(F("Random Seed (=X to set)"), F(SEED_COMMAND_STR));
+  sendApiEntry(F("Pattern Trace (? for all, =X for one)"), F(TRACE_COMMAND_STR));
+  sendApiEntry(F("Memory Watermarks"), F(MEMORY_REQUEST_STR));
+  sendApiEntry(F("Pattern Catalog"), F(PATTERNS_REQUEST_STR));
+#if defined(PERF_STATS)
+  sendApiEntry(F("Performance Counters"), F(PERF_STATS_REQUEST_STR));
+#endif // PERF_STATS
+}
+
+/*******************************************************************************
+ * @brief   Sends the pattern catalog to the connected serial device as comma
+ *          separated values, one pattern per line, with a header line. The
+ *          columns are the pattern index, name and flags: 'S' if the pattern
+ *          moves at the speed setting, 'R' if it is random and 'P' if it is
+ *          drawn with particles, or '-' if none apply.
+ */
+static void sendPatternCatalog()
+{
+  Serial.println(F("pattern,name,flags"));
+  for (int i = 0; i < Patterns::PATTERN_COUNT; i++)
+  {
+    const byte flags = getPatternFlags(i);
+    Serial.print(i);
+    Serial.print(',');
+    Serial.print(getPatternName(i));
+    Serial.print(',');
+    if (flags & PatternFlags::PATTERN_USES_SPEED)
+    {
+      Serial.print('S');
+    }
+    if (flags & PatternFlags::PATTERN_USES_RNG)
+    {
+      Serial.print('R');
+    }
+    if (flags & PatternFlags::PATTERN_USES_PARTICLES)
+    {
+      Serial.print('P');
+    }
+    if (flags == 0)
+    {
+      Serial.print('-');
+    }
+    Serial.println();
+  }
+}
+
+/*******************************************************************************
+ * @brief   Sends the frame interval statistics (in microseconds) gathered
+ *          since the last request to the connected serial device, then starts
+ *          gathering afresh.
+ */
+static void sendFrameStats()
+{
+  FrameStats stats;
+  cluster.getFrameStats(&stats);
+  cluster.resetFrameStats();
+  const unsigned long mean = stats.count ? stats.totalUs / stats.count : 0;
+  Serial.print(F("frames n="));
+  Serial.print(stats.count);
+  Serial.print(F(" min="));
+  Serial.print(stats.count ? stats.minUs : 0);
+  Serial.print(F(" max="));
+  Serial.print(stats.maxUs);
+  Serial.print(F(" mean="));
+  Serial.println(mean);
+}
+
+/*******************************************************************************
+ * @brief   Benchmarks each pattern and sends the results to the connected
+ *          serial device as comma separated values, one pattern per line,
+ *          with a header line. The columns are the pattern index, cycles per
+ *          frame, cycles per LED and the number of LEDs that could be drawn
+ *          within the 50 fps frame budget. The LEDs are not updated whilst
+ *          this runs.
+ */
+static void sendBenchmark()
+{
+  const int leds = cluster.getLedCount();
+  const unsigned long cyclesPerUs = clockCyclesPerMicrosecond();
+  Serial.println(F("pattern,cycles_per_frame,cycles_per_led,max_leds_50fps"));
+  for (int i = 0; i < Patterns::PATTERN_COUNT; i++)
+  {
+    const unsigned long totalUs = cluster.benchmarkPattern(i, BENCHMARK_FRAMES);
+    const unsigned long frameCycles = (totalUs * cyclesPerUs) / BENCHMARK_FRAMES;
+    const unsigned long ledCycles = frameCycles / leds;
+    Serial.print(i);
+    Serial.print(F(","));
+    Serial.print(frameCycles);
+    Serial.print(F(","));
+    Serial.print(ledCycles);
+    Serial.print(F(","));
+    Serial.println(ledCycles ? (FRAME_BUDGET_US * cyclesPerUs) / ledCycles : 0);
+  }
+}
+
+/*******************************************************************************
+ * @brief   Benchmarks each pattern to find the two most expensive to draw.
+ *
+ * @param   slowest     Set to the index of the most expensive pattern
+ * @param   nextSlowest Set to the index of the next most expensive pattern
+ */
+static void findSlowestPatterns(int * const slowest, int * const nextSlowest)
+{
+  unsigned long slowestUs = 0;
+  unsigned long nextSlowestUs = 0;
+  *slowest = 0;
+  *nextSlowest = 0;
+  for (int i = 0; i < Patterns::PATTERN_COUNT; i++)
+  {
+    const unsigned long totalUs = cluster.benchmarkPattern(i, BENCHMARK_FRAMES);
+    if (totalUs >= slowestUs)
+    {
+      *nextSlowest = *slowest;
+      nextSlowestUs = slowestUs;
+      *slowest = i;
+      slowestUs = totalUs;
+    }
+    else if (totalUs >= nextSlowestUs)
+    {
+      *nextSlowest = i;
+      nextSlowestUs = totalUs;
+    }
+  }
+}
+
+/*******************************************************************************
+ * @brief   Benchmarks the worst case crossfade, from the most expensive pattern
+ *          to the next most expensive.
+ *
+ * @param   slowest     The index of the most expensive pattern
+ * @param   nextSlowest The index of the next most expensive pattern
+ *
+ * @return  The CPU cycles per frame.
+ */
+static unsigned long benchmarkWorstTransition(const int slowest, const int nextSlowest)
+{
+  const unsigned long totalUs =
+    cluster.benchmarkTransition(slowest, nextSlowest, BENCHMARK_FRAMES);
+  return (totalUs * clockCyclesPerMicrosecond()) / BENCHMARK_FRAMES;
+}
+
+/*******************************************************************************
+ * @brief   Benchmarks the worst case crossfade, from the most expensive pattern
+ *          to the next most expensive, and sends the result to the connected
+ *          serial device as a single line. The fields are the patterns faded
+ *          from and to, the cycles per frame, the cycles available per frame
+ *          within the 50 fps frame budget, and whether it fits the budget. The
+ *          LEDs are not updated whilst this runs.
+ */
+static void sendTransitionBenchmark()
+{
+  int slowest = 0;
+  int nextSlowest = 0;
+  findSlowestPatterns(&slowest, &nextSlowest);
+  const unsigned long frameCycles = benchmarkWorstTransition(slowest, nextSlowest);
+  const unsigned long budgetCycles = FRAME_BUDGET_US * clockCyclesPerMicrosecond();
+  Serial.print(F("fade from="));
+  Serial.print(slowest);
+  Serial.print(F(" to="));
+  Serial.print(nextSlowest);
+  Serial.print(F(" cycles="));
+  Serial.print(frameCycles);
+  Serial.print(F(" budget="));
+  Serial.print(budgetCycles);
+  Serial.println(frameCycles <= budgetCycles ? F(" ok") : F(" OVER"));
+}
+
+/*******************************************************************************
+ * @brief   Benchmarks the pattern layers, and sends the result to the connected
+ *          serial device as a single line. The fields are the cycles per frame
+ *          of the worst case crossfade with no layers, the cycles each layer
+ *          adds in the worst case (the most expensive pattern, screen blended),
+ *          the cycles available per frame within the 50 fps frame budget, and
+ *          the number of layers that would fit within the budget on top of
+ *          the crossfade. The LEDs are not updated whilst this runs.
+ */
+static void sendLayerBenchmark()
+{
+  int slowest = 0;
+  int nextSlowest = 0;
+  findSlowestPatterns(&slowest, &nextSlowest);
+  const unsigned long baseCycles = benchmarkWorstTransition(slowest, nextSlowest);
+  const unsigned long totalUs =
+    cluster.benchmarkLayer(slowest, BlendMode::BLEND_SCREEN, BENCHMARK_FRAMES);
+  const unsigned long layerCycles =
+    (totalUs * clockCyclesPerMicrosecond()) / BENCHMARK_FRAMES;
+  const unsigned long budgetCycles = FRAME_BUDGET_US * clockCyclesPerMicrosecond();
+  const unsigned long spareCycles =
+    (budgetCycles > baseCycles) ? budgetCycles - baseCycles : 0;
+  Serial.print(F("layers base="));
+  Serial.print(baseCycles);
+  Serial.print(F(" layer="));
+  Serial.print(layerCycles);
+  Serial.print(F(" budget="));
+  Serial.print(budgetCycles);
+  Serial.print(F(" fit="));
+  Serial.println(layerCycles ? spareCycles / layerCycles : 0);
+}
+
+/*******************************************************************************
+ * @brief   Benchmarks each particle pattern with its particle pool full, and
+ *          sends the results to the connected serial device as comma separated
+ *          values, one pattern per line, with a header line. The columns are
+ *          the pattern index, cycles per frame and cycles per particle. The
+ *          LEDs are not updated whilst this runs.
+ */
+static void sendParticleBenchmark()
+{
+  const unsigned long cyclesPerUs = clockCyclesPerMicrosecond();
+  Serial.println(F("pattern,cycles_per_frame,cycles_per_particle"));
+  for (int i = 0; i < Patterns::PATTERN_COUNT; i++)
+  {
+    if (getPatternFlags(i) & PatternFlags::PATTERN_USES_PARTICLES)
+    {
+      const unsigned long totalUs = cluster.benchmarkParticles(i, BENCHMARK_FRAMES);
+      const unsigned long frameCycles = (totalUs * cyclesPerUs) / BENCHMARK_FRAMES;
+      Serial.print(i);
+      Serial.print(F(","));
+      Serial.print(frameCycles);
+      Serial.print(F(","));
+      Serial.println(frameCycles / PARTICLE_POOL_SIZE);
+    }
+  }
+}
+
+/// @brief  The running CRC-16 (CCITT) of the pattern being traced.
+static uint16_t traceChecksum = 0xFFFF;
+
+/*******************************************************************************
+ * @brief   Sends a frame of a pattern trace to the connected serial device as
+ *          a single line: the pattern index, frame number, then the duty cycle
+ *          of each LED as two hex digits. The frame is also added to the
+ *          checksum of the trace.
+ *
+ * @param   pattern     The pattern index traced
+ * @param   frame       The frame number
+ * @param   dutyCycles  The duty cycle of each LED
+ * @param   count       The number of LEDs
+ */
+static void sendTraceFrame(
+  const int pattern,
+  const unsigned int frame,
+  const byte * const dutyCycles,
+  const int count
+)
+{
+  Serial.print(pattern);
+  Serial.print(',');
+  Serial.print(frame);
+  Serial.print(',');
+  for (int i = 0; i < count; i++)
+  {
+    if (dutyCycles[i] < 0x10)
+    {
+      Serial.print('0');
+    }
+    Serial.print(dutyCycles[i], HEX);
+    traceChecksum ^= (uint16_t)dutyCycles[i] << 8;
+    for (byte bit = 0; bit < 8; bit++)
+    {
+      traceChecksum = (traceChecksum & 0x8000) ?
+        (traceChecksum << 1) ^ 0x1021 : (traceChecksum << 1);
+    }
+  }
+  Serial.println();
+}
+
+/*******************************************************************************
+ * @brief   Traces a pattern, sending every frame to the connected serial device
+ *          followed by a line with the pattern index and the checksum of the
+ *          trace in hex. The trace only changes if the pattern is drawn
+ *          differently, so can be saved and compared between builds.
+ *
+ * @param   pattern     The pattern index to trace
+ */
+static void sendPatternTrace(const int pattern)
+{
+  traceChecksum = 0xFFFF;
+  cluster.tracePattern(
+    pattern,
+    TRACE_SEED,
+    TRACE_FRAMES_PER_REVOLUTION * TRACE_REVOLUTIONS,
+    TRACE_FRAMES_PER_REVOLUTION,
+    sendTraceFrame
   );
-  Serial.println(String("Running Mode [") + RUNNING_MODE_CHAR + "]");
-  Serial.println(String("Sleep Mode [") + SLEEP_MODE_CHAR + "]");
+  Serial.print(pattern);
+  Serial.print(F(",sum,"));
+  Serial.println(traceChecksum, HEX);
+}
+
+/*******************************************************************************
+ * @brief   Sends the settings of a pattern layer to the connected serial
+ *          device as comma separated values: the layer number, pattern index,
+ *          blend mode, opacity percentage and speed in revolutions per minute.
+ *
+ * @param   index   The layer index
+ */
+static void sendLayer(const int index)
+{
+  LayerSettings layer;
+  cluster.getLayer(index, &layer);
+  Serial.print(index + 1);
+  Serial.print(',');
+  Serial.print(layer.pattern);
+  Serial.print(',');
+  Serial.print(layer.blend);
+  Serial.print(',');
+  Serial.print(layer.opacity);
+  Serial.print(',');
+  Serial.println(layer.revsPerMinute);
+}
+
+/*******************************************************************************
+ * @brief   Sends the settings of every pattern layer to the connected serial
+ *          device as comma separated values, one layer per line, with a header
+ *          line.
+ */
+static void sendLayers()
+{
+  Serial.println(F("layer,pattern,blend,opacity,rpm"));
+  for (int i = 0; i < LayerConstants::MAX_LAYERS; i++)
+  {
+    sendLayer(i);
+  }
+}
+
+/*******************************************************************************
+ * @brief   Sends the SRAM high water marks since boot to the connected serial
+ *          device as a single line. The fields are the peak heap and stack use,
+ *          the smallest gap there has been between them, the current free
+ *          SRAM (all in bytes), and whether the smallest gap is within the
+ *          safety margin.
+ */
+static void sendMemoryWatermarks()
+{
+  MemoryWatermarks marks;
+  getMemoryWatermarks(&marks);
+  Serial.print(F("mem heap="));
+  Serial.print(marks.heapPeak);
+  Serial.print(F(" stack="));
+  Serial.print(marks.stackPeak);
+  Serial.print(F(" gap="));
+  Serial.print(marks.minGap);
+  Serial.print(F(" free="));
+  Serial.print(freeMemory());
+  Serial.println(marks.minGap >= MEMORY_SAFETY_MARGIN ? F(" ok") : F(" LOW"));
+}
+
+#if defined(PERF_STATS)
+/*******************************************************************************
+ * @brief   Sends the performance counters gathered since the last request to
+ *          the connected serial device as a single line, then starts gathering
+ *          afresh. The fields are:
+ *          lps     Loop iterations per second
+ *          max     The longest loop iteration in microseconds
+ *          ser, in, led
+ *                  Time spent in the serial, input and LED subsystems, in
+ *                  microseconds per millisecond (parts per thousand)
+ *          hist    Frame interval histogram counts, separated by '/', for
+ *                  intervals below 19, 20, 21, 22, 25 and 40ms, then the rest
+ *          ee      The number of EEPROM bytes written since start up
+ *          free    The free SRAM in bytes
+ */
+static void sendPerfStats()
+{
+  const unsigned long elapsedMs = max(millis() - perfCounters.startMs, 1UL);
+  Serial.print(F("stats lps="));
+  Serial.print(perfPerSecond(perfCounters.loops, elapsedMs));
+  Serial.print(F(" max="));
+  Serial.print(perfCounters.maxLoopUs);
+  Serial.print(F(" ser="));
+  Serial.print(perfCounters.subsystemUs[PerfSerial] / elapsedMs);
+  Serial.print(F(" in="));
+  Serial.print(perfCounters.subsystemUs[PerfInputs] / elapsedMs);
+  Serial.print(F(" led="));
+  Serial.print(perfCounters.subsystemUs[PerfLeds] / elapsedMs);
+  Serial.print(F(" hist="));
+  for (int i = 0; i < PERF_FRAME_BIN_COUNT; i++)
+  {
+    if (i != 0)
+    {
+      Serial.print(F("/"));
+    }
+    Serial.print(perfCounters.frameBins[i]);
+  }
+  Serial.print(F(" ee="));
+  Serial.print(cluster.getSettingsWriteCount());
+  Serial.print(F(" free="));
+  Serial.println(freeMemory());
+  perfReset();
+}
+#endif // PERF_STATS
+
+/*******************************************************************************
+ * @brief   Sends the average number of PWM output writes per second made by
+ *          each pattern to the connected serial device.
+ */
+static void sendWriteStats()
+{
+  Serial.print(F("writes"));
+  for (int i = 0; i < Patterns::PATTERN_COUNT; i++)
+  {
+    Serial.print(F(" "));
+    Serial.print(i);
+    Serial.print(F("="));
+    Serial.print(cluster.getWritesPerSecond(i));
+  }
+  Serial.println();
 }
 
 /***************************************************************************
@@ -257,18 +776,162 @@ static void sendApi()
  */
 static int getIncomingValue(const char * const command, const size_t chars)
 {
-  const int offset = (command[0] == '=') ? 1 : 0;
-  String value = "";
-  for(int i = offset; i < chars; i++)
+  const size_t offset = (command[0] == '=') ? 1 : 0;
+  int value = 0;
+  for(size_t i = offset; i < chars; i++)
   {
     if (!isDigit(command[i]))
     {
-      value = "0";
+      value = 0;
       break;
     }
-    value += (char)command[i];
+    // The values are range checked when set, so saturate rather than overflow
+    value = min((10 * value) + (command[i] - '0'), 10000);
+  }
+  return value;
+}
+
+/***************************************************************************
+ * @brief   Gets a list of comma separated values from an incoming command.
+ *          Each value is parsed as by getIncomingValue().
+ *
+ * @param   command  The values, without the command character or '='
+ * @param   chars    The number of characters in the values
+ * @param   values   The array to populate with the values
+ * @param   count    The most values to read
+ *
+ * @return  The number of values read.
+ */
+static int getIncomingValues(
+  const char * const command,
+  const size_t chars,
+  int * const values,
+  const int count
+)
+{
+  int found = 0;
+  size_t start = 0;
+  while (found < count && start < chars)
+  {
+    size_t end = start;
+    while (end < chars && command[end] != ',')
+    {
+      end++;
+    }
+    values[found++] = getIncomingValue(command + start, end - start);
+    start = end + 1;
+  }
+  return found;
+}
+
+/***************************************************************************
+ * @brief   Handles a command to set up a pattern layer, in the form
+ *          "lN=pattern,blend,opacity,rpm", where N is the layer number from 1.
+ *          Values left off the end are unchanged. Without a value, the
+ *          settings of all layers are sent instead.
+ *
+ * @param   command  The command, after the command character
+ * @param   chars    The number of characters in the command
+ */
+static void handleLayerCommand(const char * const command, const size_t chars)
+{
+  const char * const assign = (const char *)memchr(command, '=', chars);
+  if (assign == nullptr)
+  {
+    sendLayers();
+    return;
+  }
+  const int index = getIncomingValue(command, assign - command) - 1;
+  if (index < 0 || index >= LayerConstants::MAX_LAYERS)
+  {
+    Serial.println(F("Unknown layer"));
+    return;
+  }
+  LayerSettings layer;
+  cluster.getLayer(index, &layer);
+  int values[4] = {
+    layer.pattern, layer.blend, layer.opacity, layer.revsPerMinute
+  };
+  getIncomingValues(assign + 1, chars - (assign + 1 - command), values, 4);
+  layer.pattern = min(values[0], 255);
+  layer.blend = min(values[1], 255);
+  layer.opacity = min(values[2], 255);
+  layer.revsPerMinute = min(values[3], 255);
+  if (cluster.setLayer(index, layer))
+  {
+    Serial.print(LAYER_MODE_CHAR);
+    Serial.print(F("="));
+    sendLayer(index);
+  }
+  else
+  {
+    Serial.println(F("Invalid layer"));
+  }
+}
+
+/*******************************************************************************
+ * @brief   Handles a pattern trace command, "trace?" to trace every pattern or
+ *          "trace=X" to trace pattern X. The traces are preceded by a header
+ *          line. The LEDs are not updated whilst this runs.
+ *
+ * @param   command  The command
+ * @param   chars    The number of characters in the command
+ */
+static void handleTraceCommand(const char * const command, const size_t chars)
+{
+  const size_t offset = strlen(TRACE_COMMAND_STR);
+  const bool single = (chars > offset + 1) && (command[offset] == '=');
+  const int pattern = single ?
+    getIncomingValue(command + offset + 1, chars - offset - 1) : 0;
+  if (pattern >= Patterns::PATTERN_COUNT)
+  {
+    Serial.println(F("Unknown pattern"));
+    return;
+  }
+  Serial.println(F("pattern,frame,duty_cycles"));
+  if (single)
+  {
+    sendPatternTrace(pattern);
+  }
+  else
+  {
+    for (int i = 0; i < Patterns::PATTERN_COUNT; i++)
+    {
+      sendPatternTrace(i);
+    }
+  }
+}
+
+/*******************************************************************************
+ * @brief   Handles a random seed command, "seed" or "seed?" to request the
+ *          seed or "seed=X" to set it. The seed is only set if X is a number
+ *          from 0 to 65535, so that a mistyped command does not restart the
+ *          patterns from some other seed.
+ *
+ * @param   command  The command
+ * @param   chars    The number of characters in the command
+ */
+static void handleSeedCommand(const char * const command, const size_t chars)
+{
+  const size_t offset = strlen(SEED_COMMAND_STR);
+  if ((chars > offset) && (command[offset] == '='))
+  {
+    // Seeds are 16-bit, so parse them in full rather than saturating
+    unsigned long seed = 0;
+    size_t i = offset + 1;
+    for (; i < chars && isDigit(command[i]) && seed <= MAX_SEED; i++)
+    {
+      seed = (10 * seed) + (command[i] - '0');
+    }
+    if ((i == offset + 1) || (i < chars) || (seed > MAX_SEED))
+    {
+      Serial.println(F("Invalid seed"));
+      return;
+    }
+    cluster.setRandomSeed(seed);
   }
-  return value.toInt();
+  Serial.print(F("seed="));
+  Serial.println(cluster.getRandomSeed());
 }
 
 /***************************************************************************
@@ -280,13 +943,62 @@ static int getIncomingValue(const char * const command, const size_t chars)
 static void handleSerialCommand(const char * const command, const size_t chars)
 {
   const SettingModes currentMode = mode;
-  if (cluster != nullptr && chars > 0)
+  if (chars > 0)
   {
-    const int compare = strncmp(command, API_REQUEST_STR, chars);
     if (strncmp(command, API_REQUEST_STR, strlen(API_REQUEST_STR)) == 0)
     {
       sendApi();
     }
+    else if (strncmp(command, FRAME_STATS_REQUEST_STR, strlen(FRAME_STATS_REQUEST_STR)) == 0)
+    {
+      sendFrameStats();
+    }
+    else if (strncmp(command, WRITE_STATS_REQUEST_STR, strlen(WRITE_STATS_REQUEST_STR)) == 0)
+    {
+      sendWriteStats();
+    }
+    else if (strncmp(command, BENCHMARK_REQUEST_STR, strlen(BENCHMARK_REQUEST_STR)) == 0)
+    {
+      sendBenchmark();
+    }
+    else if (strncmp(command, FADE_BENCH_REQUEST_STR, strlen(FADE_BENCH_REQUEST_STR)) == 0)
+    {
+      sendTransitionBenchmark();
+    }
+    else if (strncmp(command, SEED_COMMAND_STR, strlen(SEED_COMMAND_STR)) == 0)
+    {
+      handleSeedCommand(command, chars);
+    }
+    else if (strncmp(command, TRACE_COMMAND_STR, strlen(TRACE_COMMAND_STR)) == 0)
+    {
+      handleTraceCommand(command, chars);
+    }
+    else if (strncmp(command, PARTICLE_REQUEST_STR, strlen(PARTICLE_REQUEST_STR)) == 0)
+    {
+      sendParticleBenchmark();
+    }
+    else if (strncmp(command, LAYERS_REQUEST_STR, strlen(LAYERS_REQUEST_STR)) == 0)
+    {
+      sendLayers();
+    }
+    else if (strncmp(command, LAYER_BENCH_REQUEST_STR, strlen(LAYER_BENCH_REQUEST_STR)) == 0)
+    {
+      sendLayerBenchmark();
+    }
+    else if (strncmp(command, MEMORY_REQUEST_STR, strlen(MEMORY_REQUEST_STR)) == 0)
+    {
+      sendMemoryWatermarks();
+    }
+    else if (strncmp(command, PATTERNS_REQUEST_STR, strlen(PATTERNS_REQUEST_STR)) == 0)
+    {
+      sendPatternCatalog();
+    }
+#if defined(PERF_STATS)
+    else if (strncmp(command, PERF_STATS_REQUEST_STR, strlen(PERF_STATS_REQUEST_STR)) == 0)
+    {
+      sendPerfStats();
+    }
+#endif // PERF_STATS
     else
     {
       const char cmd = toupper(command[0]);
@@ -304,7 +1016,7 @@ static void handleSerialCommand(const char * const command, const size_t chars)
             if (testValue)
             {
               newValue = getIncomingValue(command + 1, chars - 1);
-              pattern = cluster->setPattern(newValue);
+              pattern = cluster.setPattern(newValue);
             }
             else
             {
@@ -312,7 +1024,9 @@ static void handleSerialCommand(const char * const command, const size_t chars)
               pattern = toggleClusterValue(inc ? 1 : -1);
               setMode(currentMode);
             }
-            Serial.println(String(PATTERN_MODE_CHAR) + "=" + pattern);
+            Serial.print(PATTERN_MODE_CHAR);
+            Serial.print(F("="));
+            Serial.println(pattern);
           }
           break;
 
@@ -322,15 +1036,17 @@ static void handleSerialCommand(const char * const command, const size_t chars)
             if (testValue)
             {
               newValue = getIncomingValue(command + 1, chars - 1);
-              speed = cluster->setSpeedPercent(newValue);
+              speed = cluster.setSpeedPercent(newValue);
             }
             else
             {
               setMode(SettingModes::Speed);
-              speed = LedCluster::toSpeedPercentage(toggleClusterValue(inc ? 1 : -1));
+              speed = DisplayCluster::toSpeedPercentage(toggleClusterValue(inc ? 1 : -1));
               setMode(currentMode);
             }
-            Serial.println(String(SPEED_MODE_CHAR) + "=" + speed);
+            Serial.print(SPEED_MODE_CHAR);
+            Serial.print(F("="));
+            Serial.println(speed);
           }
           break;
 
@@ -340,32 +1056,75 @@ static void handleSerialCommand(const char * const command, const size_t chars)
             if (testValue)
             {
               newValue = getIncomingValue(command + 1, chars - 1);
-              brightness = cluster->setBrightnessPercent(newValue);
+              brightness = cluster.setBrightnessPercent(newValue);
             }
             else
             {
               setMode(SettingModes::Brightness);
-              brightness = LedCluster::toBrightnessPercentage(toggleClusterValue(inc ? 1 : -1));
+              brightness = DisplayCluster::toBrightnessPercentage(toggleClusterValue(inc ? 1 : -1));
               setMode(currentMode);
             }
-            Serial.println(String(BRIGHTNESS_MODE_CHAR) + "=" + brightness);
+            Serial.print(BRIGHTNESS_MODE_CHAR);
+            Serial.print(F("="));
+            Serial.println(brightness);
+          }
+          break;
+
+        case TRANSITION_MODE_CHAR:
+          {
+            int transition = 0;
+            if (testValue)
+            {
+              newValue = getIncomingValue(command + 1, chars - 1);
+              transition = cluster.setTransitionTime(newValue);
+            }
+            else
+            {
+              transition = cluster.updateTransitionTime(inc ? 1 : -1);
+            }
+            Serial.print(TRANSITION_MODE_CHAR);
+            Serial.print(F("="));
+            Serial.println(transition);
+          }
+          break;
+
+        case DENSITY_MODE_CHAR:
+          {
+            int density = 0;
+            if (testValue)
+            {
+              newValue = getIncomingValue(command + 1, chars - 1);
+              density = cluster.setDensity(newValue);
+            }
+            else
+            {
+              density = cluster.updateDensity(inc ? 1 : -1);
+            }
+            Serial.print(DENSITY_MODE_CHAR);
+            Serial.print(F("="));
+            Serial.println(density);
           }
           break;
 
+        case LAYER_MODE_CHAR:
+          handleLayerCommand(command + 1, chars - 1);
+          break;
+
         case RUNNING_MODE_CHAR:
           setMode(SettingModes::Running);
-          cluster->startUp();
+          cluster.startUp();
           Serial.println(RUNNING_MODE_CHAR);
           break;
 
         case SLEEP_MODE_CHAR:
           setMode(SettingModes::Sleep);
-          cluster->shutdown();
+          cluster.shutdown();
           Serial.println(SLEEP_MODE_CHAR);
           break;
 
         default:
-          Serial.println(String("Unknown command: ") + command);
+          Serial.print(F("Unknown command: "));
+          Serial.println(command);
           sendApi();
           break;
       }
@@ -374,30 +1133,42 @@ static void handleSerialCommand(const char * const command, const size_t chars)
 }
 
 /*******************************************************************************
- * @brief   Check for serial connection and any incoming requests.
+ * @brief   Check for serial connection and any incoming requests. Characters
+ *          are gathered into the command line buffer as they arrive, and the
+ *          command is only handled once its line has ended, as a command may
+ *          arrive over several calls. A line too long for the buffer is
+ *          dropped. At most one command is handled per call, so that a burst
+ *          of commands does not hold up the frames.
  */
 static void pollSerial()
 {
+  PERF_SCOPE(PerfSerial);
   if (Serial)
   {
-    const size_t available = Serial.available();
-    if (available != 0)
+    while (Serial.available() > 0)
     {
-      char *command = new char[available + 1];
-      Serial.readBytes(command, available);
-
-      // Strip new line
-      if (command[available - 1] == '\n')
+      const char c = Serial.read();
+      if (c == '\n' || c == '\r')
+      {
+        const bool complete = !serialLineOverflow && (serialLineLength > 0);
+        serialLine[serialLineLength] = '\0';
+        serialLineLength = 0;
+        serialLineOverflow = false;
+        if (complete)
+        {
+          handleSerialCommand(serialLine, strlen(serialLine));
+          break;
+        }
+      }
+      else if (serialLineLength < SERIAL_COMMAND_LENGTH)
       {
-        command[available - 1] = '\0';
+        serialLine[serialLineLength] = c;
+        ++serialLineLength;
       }
       else
       {
-        command[available] = '\0';
+        serialLineOverflow = true;
       }
-      handleSerialCommand(command, strlen(command));
-      delete[] command;
-      command = nullptr;
     }
   }
 }
@@ -408,19 +1179,22 @@ static void pollSerial()
 void setup()
 {
   Serial.begin(9600);
-  byte ledPins[] = {
-    Pins::DisplayLED1,
-    Pins::DisplayLED2,
-    Pins::DisplayLED3,
-    Pins::DisplayLED4,
-    Pins::DisplayLED5,
-    Pins::DisplayLED6
-  };
 
-  cluster = new LedCluster(ledPins, 6);
+  // Set up the LED outputs and load the settings, now that the core is ready
+  cluster.begin();
+
+  // Have the buttons time stamp their edges from pin change interrupts, so
+  // presses are handled promptly and short taps are not missed
+  upBtn.enableInterrupt();
+  downBtn.enableInterrupt();
+  settingSelectionBtn.enableInterrupt();
+
+#if defined(PERF_STATS)
+  perfReset();
+#endif // PERF_STATS
 
   // Seed the randomiser with the current noise on analogue input zero
-  randomSeed(analogRead(0));
+  cluster.setRandomSeed(analogRead(0));
 }
 
 /*******************************************************************************
@@ -428,6 +1202,7 @@ void setup()
  */
 void loop()
 {
+  PERF_LOOP_SCOPE();
 
   pollSerial();
   // Check the inputs for any changes
@@ -436,7 +1211,7 @@ void loop()
   settingSelectionBtn.poll();
 
   // Update the LED cluster levels
-  cluster->poll();
+  cluster.poll();
 
   // If the speed, brightness or pattern is currently being changed, time out
   // after a certain time, back into running mode and turn off the setting LEDs